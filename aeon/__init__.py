@@ -1,4 +1,5 @@
 from .dataloader import DataLoader, LoaderRuntimeError
+from .warm_cache import warm_cache
 
 try:
     from .protobackends import gen_backend
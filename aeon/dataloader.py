@@ -23,6 +23,22 @@ class LoaderRuntimeError(RuntimeError):
     pass
 
 
+def load_library():
+    """
+    Loads the aeon_lib extension through ctypes.
+    """
+    if (sys.version_info > (3, 0)):
+        # Python 3 builds extensions with names like
+        # aeon_lib.cpython-35m-x86_64-linux-gnu.so
+        # So we use this to do the name resolution
+        import importlib.util
+        libpath = importlib.util.find_spec('aeon_lib').origin
+    else:
+        path = os.path.dirname(os.path.dirname(os.path.realpath(__file__)))
+        libpath = os.path.join(path, 'aeon_lib.so')
+    return ct.cdll.LoadLibrary(libpath)
+
+
 class DataLoader(object):
 
     """
@@ -51,6 +67,7 @@ class DataLoader(object):
         self._config = config
 
         self._buffer_id = 0
+        self._buffer_count = config.get('device_buffer_count', 2)
         self._item_index = 0
 
         self._load_library()
@@ -71,16 +88,7 @@ class DataLoader(object):
         self._compute_nbatches()
 
     def _load_library(self):
-        if (sys.version_info > (3, 0)):
-            # Python 3 builds extensions with names like
-            # aeon_lib.cpython-35m-x86_64-linux-gnu.so
-            # So we use this to do the name resolution
-            import importlib.util
-            libpath = importlib.util.find_spec('aeon_lib').origin
-        else:
-            path = os.path.dirname(os.path.dirname(os.path.realpath(__file__)))
-            libpath = os.path.join(path, 'aeon_lib.so')
-        self.loaderlib = ct.cdll.LoadLibrary(libpath)
+        self.loaderlib = load_library()
         self.loaderlib.get_error_message.restype = ct.c_char_p
         self.loaderlib.start.restype = ct.c_void_p
 
@@ -95,6 +103,12 @@ class DataLoader(object):
         self.loaderlib.itemCount.argtypes = [ct.c_void_p]
         self.loaderlib.itemCount.restype = ct.c_int
 
+        self.loaderlib.stats.argtypes = [ct.c_void_p]
+        self.loaderlib.stats.restype = ct.c_char_p
+
+        self.loaderlib.dump_trace.argtypes = [ct.c_void_p, ct.c_char_p]
+        self.loaderlib.dump_trace.restype = ct.c_int
+
     def _raise_loader_error(self):
         """
         C api can't easily raise python exceptions, so it returns an error code
@@ -165,6 +179,32 @@ class DataLoader(object):
 
         return ret
 
+    def stats(self):
+        """
+        Snapshot of the loader's pipeline telemetry as a dict: time spent
+        in each stage, cache hits and misses, buffer pool occupancy, time
+        spent waiting in next() and the likely bottleneck ('io', 'decode'
+        or 'consumer').  Times are in microseconds.
+        """
+        ret = self.loaderlib.stats(self.loader)
+
+        if ret is None:
+            self._raise_loader_error()
+
+        return json.loads(ret.decode('utf-8'))
+
+    def dump_trace(self, filename=None):
+        """
+        Write the timeline of loader activity recorded so far in Chrome
+        trace format, to filename or else to the trace_file given in the
+        config.  Tracing must have been turned on with trace_file.
+        """
+        if filename is None:
+            filename = ''
+        if self.loaderlib.dump_trace(
+                self.loader, ct.c_char_p(filename.encode(encoding='utf-8'))) == -1:
+            self._raise_loader_error()
+
     def _reset(self):
         """
         C api wrapper with exception handling
@@ -201,8 +241,8 @@ class DataLoader(object):
         """
         dtuple = self._next(self._buffer_id)
 
-        # Toggle _buffer_id between 0 and 1
-        self._buffer_id = 1 - self._buffer_id
+        # Rotate through the backend's device buffers
+        self._buffer_id = (self._buffer_id + 1) % self._buffer_count
 
         return dtuple
 
@@ -18,7 +18,7 @@ class CpuBackend(object):
         self.rng_seed = 0
 
     def consume(self, buf_index, hostlist, devlist):
-        assert 0 <= buf_index < 2, 'Can only double buffer'
+        assert 0 <= buf_index < len(hostlist), 'Buffer index out of range'
         if devlist[buf_index] is None:
             devlist[buf_index] = np.empty_like(hostlist[buf_index].T)
         # print(devlist[buf_index].shape, devlist[buf_index].dtype)
@@ -42,7 +42,7 @@ class GpuBackend(object):
         self.ctx = drv.Device(device_id).make_context()
 
     def consume(self, buf_index, hostlist, devlist):
-        assert 0 <= buf_index < 2, 'Can only double buffer'
+        assert 0 <= buf_index < len(hostlist), 'Buffer index out of range'
         self.ctx.push()
         hbuf = hostlist[buf_index]
         if devlist[buf_index] is None:
@@ -86,7 +86,7 @@ class MultiGpuBackend(object):
         self.ctxs[0].push()
 
     def consume(self, buf_index, hostlist, devlist):
-        assert 0 <= buf_index < 2, 'Can only double buffer'
+        assert 0 <= buf_index < len(hostlist), 'Buffer index out of range'
         hbuf = hostlist[buf_index]
 
         frag_sz, ndims, ndtype = hbuf.shape[0] // self.num_dev, hbuf.shape[1], hbuf.dtype
@@ -0,0 +1,73 @@
+# ----------------------------------------------------------------------------
+# Copyright 2016 Nervana Systems Inc.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ----------------------------------------------------------------------------
+"""
+Fills the cache_directory of a DataLoader config ahead of a job, so that its
+first epoch reads from the cache:
+
+    python -m aeon.warm_cache config.json --threads 16
+"""
+import argparse
+import ctypes as ct
+import json
+import sys
+
+from .dataloader import load_library, LoaderRuntimeError
+
+
+def warm_cache(config, thread_count=0, verbose=True):
+    """
+    Writes every block of the dataset described by `config` to its
+    cache_directory, on `thread_count` threads (one per cpu if 0).  Blocks
+    which are already cached are skipped.  Progress and throughput are
+    printed to stderr when `verbose`.
+    """
+    lib = load_library()
+    lib.get_error_message.restype = ct.c_char_p
+    lib.warm_cache.argtypes = [ct.c_char_p, ct.c_int, ct.c_int]
+    lib.warm_cache.restype = ct.c_int
+
+    result = lib.warm_cache(
+        ct.c_char_p(json.dumps(config).encode(encoding='utf-8')),
+        thread_count,
+        1 if verbose else 0
+    )
+    if result != 0:
+        raise LoaderRuntimeError(
+            'error warming cache: {}'.format(lib.get_error_message())
+        )
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='fill the cache_directory of a DataLoader config')
+    parser.add_argument('config', help='JSON file with the DataLoader config')
+    parser.add_argument('--threads', type=int, default=0,
+                        help='number of threads, one per cpu if 0')
+    parser.add_argument('--quiet', action='store_true',
+                        help="don't report progress")
+    args = parser.parse_args(argv)
+
+    with open(args.config) as f:
+        config = json.load(f)
+    try:
+        warm_cache(config, args.threads, not args.quiet)
+    except LoaderRuntimeError as e:
+        sys.stderr.write('{}\n'.format(e))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -4,7 +4,9 @@ SRCS="
     api.cpp
     avi.cpp
     batch_iterator.cpp
+    block_iterator_async.cpp
     block_iterator_sequential.cpp
+    block_iterator_shuffle_buffer.cpp
     block_iterator_shuffled.cpp
     block_loader.cpp
     block_loader_cpio_cache.cpp
@@ -16,8 +18,13 @@ SRCS="
     buffer_pool.cpp
     buffer_pool_in.cpp
     buffer_pool_out.cpp
+    cache_index.cpp
+    cache_warmer.cpp
+    cache_writer.cpp
     cap_mjpeg_decoder.cpp
     cpio.cpp
+    cpu_affinity.cpp
+    decode_executor.cpp
     etl_audio.cpp
     etl_boundingbox.cpp
     etl_char_map.cpp
@@ -48,13 +55,24 @@ SRCS="
     provider_video_classifier.cpp
     provider_video_only.cpp
     python_backend.cpp
+    python_loader.cpp
     specgram.cpp
+    telemetry.cpp
+    trace.cpp
     util.cpp
     wav_data.cpp
 "
 # remove newlines
 export SRCS="$(echo ${SRCS} | sed 's/\n//g')"
 
+# the python binding, left out of libaeon
+PYTHON_SRCS="
+    api.cpp
+    python_backend.cpp
+    python_loader.cpp
+"
+export PYTHON_SRCS="$(echo ${PYTHON_SRCS} | sed 's/\n//g')"
+
 export CFLAGS="-Wno-deprecated-declarations -std=c++11"
 export CC="clang++"
 
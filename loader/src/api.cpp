@@ -29,7 +29,7 @@ extern void* start(const char* loaderConfigString, PyObject* pbackend)
     static_assert(sizeof(int) == 4, "int is not 4 bytes");
     try {
 
-        loader* data_loader = new loader(loaderConfigString, pbackend);
+        python_loader* data_loader = new python_loader(loaderConfigString, pbackend);
 
         int result = data_loader->start();
         if (result != 0) {
@@ -58,7 +58,7 @@ extern int error()
     }
 }
 
-extern PyObject* next(loader* data_loader, int bufIdx)
+extern PyObject* next(python_loader* data_loader, int bufIdx)
 {
     try {
         return data_loader->next(bufIdx);
@@ -70,7 +70,7 @@ extern PyObject* next(loader* data_loader, int bufIdx)
     }
 }
 
-extern PyObject* shapes(loader* data_loader)
+extern PyObject* shapes(python_loader* data_loader)
 {
     try {
         return data_loader->shapes();
@@ -82,7 +82,61 @@ extern PyObject* shapes(loader* data_loader)
     }
 }
 
-extern int itemCount(loader* data_loader)
+extern const char* stats(python_loader* data_loader)
+{
+    // JSON snapshot of the loader's telemetry, valid until the next call on
+    // this loader
+    try {
+        return data_loader->stats_c_str();
+    } catch(std::exception& ex) {
+        last_error_message = ex.what();
+        return nullptr;
+    }
+}
+
+extern int dump_trace(python_loader* data_loader, const char* filename)
+{
+    try {
+        data_loader->dump_trace(filename == nullptr ? "" : filename);
+        return 0;
+    } catch(std::exception& ex) {
+        last_error_message = ex.what();
+        return -1;
+    }
+}
+
+extern int warm_cache(const char* loaderConfigString, int thread_count, int verbose)
+{
+    // fills the cache_directory of the config, printing progress to stderr
+    // when verbose
+    try {
+        cache_warmer warmer(loaderConfigString);
+        std::function<void(const cache_warmer::progress&)> report = nullptr;
+        if (verbose) {
+            report = [](const cache_warmer::progress& p) {
+                std::cerr << "warming cache: " << p.str() << std::endl;
+            };
+        }
+        auto result = warmer.run(thread_count, report);
+        if (result.blocks_evicted > 0) {
+            std::cerr << "WARNING cache_size_mb only holds "
+                      << result.block_count - result.blocks_evicted - result.blocks_failed
+                      << " of " << result.block_count << " blocks" << std::endl;
+        }
+        if (result.blocks_failed > 0) {
+            std::stringstream ss;
+            ss << result.blocks_failed << " of " << result.block_count << " blocks could not be cached";
+            last_error_message = ss.str();
+            return -1;
+        }
+        return 0;
+    } catch(std::exception& ex) {
+        last_error_message = ex.what();
+        return -1;
+    }
+}
+
+extern int itemCount(python_loader* data_loader)
 {
     try {
         return data_loader->itemCount();
@@ -92,7 +146,7 @@ extern int itemCount(loader* data_loader)
     }
 }
 
-extern int reset(loader* data_loader)
+extern int reset(python_loader* data_loader)
 {
     try {
         return data_loader->reset();
@@ -102,7 +156,7 @@ extern int reset(loader* data_loader)
     }
 }
 
-extern int stop(loader* data_loader)
+extern int stop(python_loader* data_loader)
 {
     try {
         data_loader->stop();
@@ -15,7 +15,8 @@
 
 #pragma once
 #include "cpio.hpp"
-#include "loader.hpp"
+#include "python_loader.hpp"
+#include "cache_warmer.hpp"
 
 extern "C" {
 
@@ -24,10 +25,13 @@ static std::string last_error_message;
 extern const char* get_error_message();
 extern int error();
 extern void* start(const char* loaderConfigString, PyObject* pbackend);
-extern PyObject* next(nervana::loader* data_loader, int bufIdx);
-extern int reset(nervana::loader* data_loader);
-extern int stop(nervana::loader* data_loader);
-extern int itemCount(nervana::loader* data_loader);
-extern PyObject* shapes(nervana::loader* data_loader);
+extern PyObject* next(nervana::python_loader* data_loader, int bufIdx);
+extern int reset(nervana::python_loader* data_loader);
+extern int stop(nervana::python_loader* data_loader);
+extern int itemCount(nervana::python_loader* data_loader);
+extern PyObject* shapes(nervana::python_loader* data_loader);
+extern const char* stats(nervana::python_loader* data_loader);
+extern int dump_trace(nervana::python_loader* data_loader, const char* filename);
+extern int warm_cache(const char* loaderConfigString, int thread_count, int verbose);
 
 }
@@ -44,8 +44,11 @@ void batch_iterator::read(buffer_in_array& dst_buffer_array)
 
 void batch_iterator::reset()
 {
-    for (auto m: *_src_buffer_array_ptr) {
-        m->reset();
+    // nothing has been read yet if the loader is reset straight after it starts
+    if (_src_buffer_array_ptr != nullptr) {
+        for (auto m: *_src_buffer_array_ptr) {
+            m->reset();
+        }
     }
 
     _src_block_iterator->reset();
@@ -56,7 +59,7 @@ void batch_iterator::reset()
 void batch_iterator::transfer_buffer_item(buffer_in* dst, buffer_in* src)
 {
     try {
-        dst->add_item(src->get_item(_i));
+        dst->share_item(*src, _i);
     } catch (std::exception& e) {
         dst->add_exception(std::current_exception());
     }
@@ -79,8 +82,9 @@ void batch_iterator::pop_item_from_block(buffer_in_array& dst_buffer_array)
 
     // because the _src_buffer_array_ptr Buffers may have been shuffled, and its shuffle
     // reorders the index, we can't just read a large contiguous block of
-    // memory out of the _src_buffer_array_ptr.  We must copy out each element one at
-    // a time
+    // memory out of the _src_buffer_array_ptr.  We must share each element one at
+    // a time.  Sharing doesn't copy the element, the minibatch keeps the block's
+    // memory alive until the minibatch buffer is reset after decoding.
     for (uint32_t idx=0; idx < src_buffer_array.size(); ++idx) {
         transfer_buffer_item(dst_buffer_array[idx], src_buffer_array[idx]);
     }
@@ -24,6 +24,7 @@ namespace nervana {
 class nervana::block_iterator
 {
 public:
+    virtual ~block_iterator() {}
     virtual void read(nervana::buffer_in_array& dest) = 0;
     virtual void reset() = 0;
 };
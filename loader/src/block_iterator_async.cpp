@@ -0,0 +1,139 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "block_iterator_async.hpp"
+#include "util.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_iterator_async::block_iterator_async(shared_ptr<block_iterator> src_block_iterator,
+                                           uint32_t depth)
+: _src(src_block_iterator), _depth(depth)
+{
+    affirm(_depth > 0, "block_iterator_async depth must be > 0");
+}
+
+block_iterator_async::~block_iterator_async()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _done = true;
+    }
+    _not_full.notify_all();
+
+    if (_thread != nullptr) {
+        _thread->join();
+        delete _thread;
+    }
+}
+
+void block_iterator_async::start(uint32_t nbuffers_in)
+{
+    for (uint32_t i = 0; i < _depth; ++i) {
+        _free.push_back(make_shared<buffer_in_array>(nbuffers_in));
+    }
+    _telemetry = telemetry::current();
+    _thread = new thread(&block_iterator_async::fetch, this);
+}
+
+void block_iterator_async::read(buffer_in_array& dest)
+{
+    unique_lock<mutex> lock(_mutex);
+    if (_thread == nullptr) {
+        start(dest.size());
+    }
+
+    while (_ready.empty()) {
+        _not_empty.wait(lock);
+    }
+
+    staged_block staged = _ready.front();
+    _ready.pop_front();
+
+    // hand the loaded buffers to the caller and keep the caller's old
+    // buffers as the staging area for a future block
+    dest.swap(*staged.block);
+    _free.push_back(staged.block);
+    lock.unlock();
+    _not_full.notify_one();
+
+    if (staged.error) {
+        rethrow_exception(staged.error);
+    }
+}
+
+void block_iterator_async::reset()
+{
+    unique_lock<mutex> lock(_mutex);
+
+    // keep the fetch thread from starting another block and wait for any
+    // block in progress, so that _src is never reset under its feet
+    _resetting = true;
+    while (_fetching) {
+        _fetch_done.wait(lock);
+    }
+
+    // blocks read ahead belong to the previous pass, throw them away
+    for (auto& staged : _ready) {
+        _free.push_back(staged.block);
+    }
+    _ready.clear();
+
+    _src->reset();
+
+    _resetting = false;
+    lock.unlock();
+    _not_full.notify_all();
+}
+
+void block_iterator_async::fetch()
+{
+    telemetry::scope scope(_telemetry);
+    trace::set_thread_name("block prefetch");
+    unique_lock<mutex> lock(_mutex);
+    while (true) {
+        while (_done == false && (_free.empty() || _resetting)) {
+            _not_full.wait(lock);
+        }
+        if (_done) {
+            break;
+        }
+
+        staged_block staged;
+        staged.block = _free.back();
+        _free.pop_back();
+        _fetching = true;
+        lock.unlock();
+
+        // the actual block load (disk, network, cpio parse) runs without
+        // holding any lock the consumer needs
+        for (auto b : *staged.block) {
+            b->reset();
+        }
+        try {
+            _src->read(*staged.block);
+        } catch (std::exception& e) {
+            staged.error = current_exception();
+        }
+
+        lock.lock();
+        _fetching = false;
+        _ready.push_back(staged);
+        _fetch_done.notify_all();
+        _not_empty.notify_one();
+    }
+}
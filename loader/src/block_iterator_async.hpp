@@ -0,0 +1,78 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "block_iterator.hpp"
+#include "telemetry.hpp"
+
+namespace nervana {
+    class block_iterator_async;
+}
+
+/* block_iterator_async
+ *
+ * Wraps another block_iterator and reads up to `depth` blocks ahead of the
+ * consumer on a background thread.  Blocks are loaded into private staging
+ * buffers and handed to the caller of read() by swapping buffers, so a block
+ * that is already loaded costs no I/O and no copy on the read thread.
+ *
+ * The background thread is started lazily on the first call to read() since
+ * the number of buffers in a block isn't known before then.  It records
+ * into the telemetry which is current on the thread that starts it.
+ */
+class nervana::block_iterator_async : public block_iterator {
+public:
+    block_iterator_async(std::shared_ptr<block_iterator> src_block_iterator, uint32_t depth);
+    virtual ~block_iterator_async();
+
+    void read(nervana::buffer_in_array& dest);
+    void reset();
+
+private:
+    block_iterator_async() = delete;
+    block_iterator_async(const block_iterator_async&) = delete;
+
+    struct staged_block {
+        std::shared_ptr<nervana::buffer_in_array> block;
+        std::exception_ptr                        error;
+    };
+
+    void start(uint32_t nbuffers_in);
+    void fetch();
+
+    std::shared_ptr<block_iterator>                         _src;
+    uint32_t                                                _depth;
+
+    std::deque<staged_block>                                _ready;
+    std::vector<std::shared_ptr<nervana::buffer_in_array>>  _free;
+
+    std::mutex                                              _mutex;
+    std::condition_variable                                 _not_empty;
+    std::condition_variable                                 _not_full;
+    std::condition_variable                                 _fetch_done;
+    std::thread*                                            _thread     = nullptr;
+    nervana::telemetry*                                     _telemetry  = nullptr;
+    bool                                                    _done       = false;
+    bool                                                    _fetching   = false;
+    bool                                                    _resetting  = false;
+};
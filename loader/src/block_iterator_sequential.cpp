@@ -14,6 +14,8 @@
 */
 
 #include "block_iterator_sequential.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -34,7 +36,12 @@ void block_iterator_sequential::read(nervana::buffer_in_array& dest)
         reset();
     }
 
+    trace::span span("load block", i);
+    auto start = chrono::steady_clock::now();
     _loader->loadBlock(dest, i);
+    if (telemetry* t = telemetry::current()) {
+        t->block_load_ns.record(telemetry::elapsed_ns(start));
+    }
 }
 
 void block_iterator_sequential::reset()
@@ -0,0 +1,121 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "block_iterator_shuffle_buffer.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+block_iterator_shuffle_buffer::block_iterator_shuffle_buffer(shared_ptr<block_iterator> src_block_iterator,
+                                                             uint32_t block_count,
+                                                             uint32_t pool_size,
+                                                             uint32_t block_size)
+: _src(src_block_iterator),
+  _blockCount(block_count),
+  _poolSize(pool_size),
+  _blockSize(block_size),
+  _rand(get_global_random_seed())
+{
+    affirm(_blockCount > 0, "shuffle buffer source must have blocks");
+    affirm(_poolSize > 0, "shuffle buffer pool_size must be > 0");
+    affirm(_blockSize > 0, "shuffle buffer block_size must be > 0");
+}
+
+bool block_iterator_shuffle_buffer::next_record(record& r, uint32_t nbuffers_in)
+{
+    while (_next >= _count) {
+        if (_blocksRead == _blockCount) {
+            return false;
+        }
+        // every record of the block is in the pool, so its buffers can be
+        // filled again
+        if (_block == nullptr) {
+            _block = unique_ptr<buffer_in_array>(new buffer_in_array(nbuffers_in));
+        }
+        for (auto b : *_block) {
+            b->reset();
+        }
+        _next  = 0;
+        _count = 0;
+        // the source moves on to the next block even if this one fails
+        _blocksRead++;
+        _src->read(*_block);
+        _count = (*_block)[0]->get_item_count();
+        affirm(_count > 0, "shuffle buffer source returned an empty block");
+    }
+
+    r.items.resize(nbuffers_in);
+    r.exceptions.assign(nbuffers_in, nullptr);
+    for (uint32_t j = 0; j < nbuffers_in; j++) {
+        try {
+            item_span item = (*_block)[j]->get_item(_next);
+            r.items[j] = make_shared<vector<char>>(item.begin(), item.end());
+        } catch (std::exception& e) {
+            r.items[j]      = nullptr;
+            r.exceptions[j] = std::current_exception();
+        }
+    }
+    _next++;
+    return true;
+}
+
+void block_iterator_shuffle_buffer::fill(uint32_t nbuffers_in)
+{
+    // a record only goes into the pool once it is complete, so the pool is
+    // left as it was if the source throws
+    while (_pool.size() < _poolSize) {
+        record r;
+        if (!next_record(r, nbuffers_in)) {
+            break;
+        }
+        _pool.push_back(move(r));
+    }
+}
+
+void block_iterator_shuffle_buffer::read(buffer_in_array& dest)
+{
+    for (uint32_t i = 0; i < _blockSize; i++) {
+        fill(dest.size());
+        if (_pool.empty()) {
+            // every record of the pass has been returned
+            _blocksRead = 0;
+            fill(dest.size());
+        }
+
+        uniform_int_distribution<size_t> pick(0, _pool.size() - 1);
+        size_t  k = pick(_rand);
+        record& r = _pool[k];
+        for (size_t j = 0; j < dest.size(); j++) {
+            if (r.exceptions[j] != nullptr) {
+                dest[j]->add_exception(r.exceptions[j]);
+            } else {
+                // the returned block keeps the copy alive
+                dest[j]->add_view(r.items[j], r.items[j]->data(), r.items[j]->size());
+            }
+        }
+        swap(r, _pool.back());
+        _pool.pop_back();
+    }
+}
+
+void block_iterator_shuffle_buffer::reset()
+{
+    _pool.clear();
+    _next       = 0;
+    _count      = 0;
+    _blocksRead = 0;
+    _src->reset();
+}
@@ -0,0 +1,96 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <exception>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "block_iterator.hpp"
+
+namespace nervana {
+    class block_iterator_shuffle_buffer;
+}
+
+/* block_iterator_shuffle_buffer
+ *
+ * Shuffles records across blocks.  Keeps a pool of `pool_size` records,
+ * read block by block from another block_iterator, and makes up each block
+ * it returns from `block_size` records drawn uniformly at random from the
+ * pool.  Every record drawn is replaced by the next record from the source.
+ *
+ * The source goes round its `block_count` blocks over and over.  Once a
+ * whole pass has been read the pool is drained before the next pass is
+ * read, so every record is returned exactly once per pass, and the last
+ * records of a pass are drawn from an ever smaller pool.  A block the
+ * source fails to read counts towards the pass.
+ *
+ * A record is equally likely to be returned at any time while it is in the
+ * pool, so records from many blocks end up interleaved while the source is
+ * still read one whole block at a time.  The larger the pool compared to
+ * the source blocks, the closer this comes to a global shuffle.
+ *
+ * Each record is copied out of its source block as it enters the pool, so
+ * the source is read into a single block of buffers, which is refilled as
+ * soon as all of its records are in the pool.  Records are handed on to the
+ * returned block without copying them again (see buffer_in::add_view).
+ * Memory use is the pool of `pool_size` records and one source block, plus
+ * whatever returned blocks are still held.  Sharing records straight out of
+ * the source blocks would keep a block alive until its last record had been
+ * drawn, which with uniform draws keeps many times the pool in memory.
+ *
+ * reset() empties the pool and resets the source, so the records of the
+ * current pass which have not been returned yet are dropped.
+ */
+class nervana::block_iterator_shuffle_buffer : public block_iterator {
+public:
+    block_iterator_shuffle_buffer(std::shared_ptr<block_iterator> src_block_iterator,
+                                  uint32_t block_count,
+                                  uint32_t pool_size,
+                                  uint32_t block_size);
+
+    void read(nervana::buffer_in_array& dest);
+    void reset();
+
+private:
+    block_iterator_shuffle_buffer() = delete;
+    block_iterator_shuffle_buffer(const block_iterator_shuffle_buffer&) = delete;
+
+    // a copy of each component of a record, or the exception it holds
+    struct record {
+        std::vector<std::shared_ptr<std::vector<char>>> items;
+        std::vector<std::exception_ptr>                 exceptions;
+    };
+
+    // copies the next record of the pass into `r`, reading another block if
+    // needed, or returns false once every record of the pass is in the pool
+    bool next_record(record& r, uint32_t nbuffers_in);
+    // tops the pool up to _poolSize from the current pass
+    void fill(uint32_t nbuffers_in);
+
+    std::shared_ptr<block_iterator>                     _src;
+    uint32_t                                            _blockCount;
+    uint32_t                                            _poolSize;
+    uint32_t                                            _blockSize;
+    std::minstd_rand0                                   _rand;
+
+    std::vector<record>                                 _pool;
+    std::unique_ptr<nervana::buffer_in_array>           _block;     // being copied from
+    int                                                 _next  = 0;
+    int                                                 _count = 0; // records in _block
+    uint32_t                                            _blocksRead = 0; // in this pass
+};
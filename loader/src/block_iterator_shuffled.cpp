@@ -19,6 +19,8 @@
 
 #include "util.hpp"
 #include "block_iterator_shuffled.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -42,17 +44,17 @@ void block_iterator_shuffled::shuffle()
 
 void block_iterator_shuffled::read(nervana::buffer_in_array &dest)
 {
+    trace::span span("load block", *_it);
+    auto start = chrono::steady_clock::now();
     _loader->loadBlock(dest, *_it);
+    if (telemetry* t = telemetry::current()) {
+        t->block_load_ns.record(telemetry::elapsed_ns(start));
+    }
 
-    // shuffle the objects in BufferPair dest
+    // shuffle the records in dest
     // seed the shuffle with the seed passed in the constructor + the _epoch
     // to ensure that the buffer shuffles are deterministic wrt the input seed.
-    // HACK: pass the same seed to both shuffles to ensure that both buffers
-    // are shuffled in the same order.
-
-    for (auto d: dest) {
-        d->shuffle(get_global_random_seed() + _epoch);
-    }
+    dest.shuffle(get_global_random_seed() + _epoch);
 
     if(++_it == _indices.end()) {
         reset();
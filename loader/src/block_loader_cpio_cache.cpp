@@ -22,6 +22,8 @@
 
 #include "cpio.hpp"
 #include "block_loader_cpio_cache.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -32,28 +34,106 @@ using namespace nervana;
 #define OPEN_MAX 128
 #endif
 
+namespace {
+    // load every item of an open cpio file into dest
+    template <typename Reader>
+    void read_items(Reader& reader, buffer_in_array& dest)
+    {
+        for(int i=0; i < reader.itemCount(); ++i) {
+            for (auto d : dest) {
+                try {
+                    reader.read(*d);
+                } catch (std::exception& e) {
+                    d->add_exception(std::current_exception());
+                }
+            }
+        }
+    }
+
+    // add every item of src to dest without copying it
+    void share_items(buffer_in_array& src, buffer_in_array& dest)
+    {
+        for (size_t b = 0; b < src.size(); b++) {
+            for (int i = 0; i < src[b]->get_item_count(); i++) {
+                try {
+                    dest[b]->share_item(*src[b], i);
+                } catch (std::exception& e) {
+                    dest[b]->add_exception(std::current_exception());
+                }
+            }
+        }
+    }
+}
+
 block_loader_cpio_cache::block_loader_cpio_cache(const string& rootCacheDir,
                                                  const string& cache_id,
                                                  const string& version,
-                                                 shared_ptr<block_loader> loader)
+                                                 shared_ptr<block_loader> loader,
+                                                 int write_depth,
+                                                 uint64_t size_limit)
 : block_loader(loader->blockSize()), _loader(loader)
 {
+    if (size_limit > 0) {
+        _index = make_shared<cache_index>(rootCacheDir, size_limit);
+    }
+
     invalidateOldCache(rootCacheDir, cache_id, version);
 
     _cacheDir = rootCacheDir + "/" + cache_id + "_" + version;
 
     makeDirectory(_cacheDir);
+
+    if (write_depth > 0) {
+        _writer = cache_writer::get(write_depth);
+    }
+}
+
+block_loader_cpio_cache::~block_loader_cpio_cache()
+{
+    // queued blocks refer to our telemetry
+    if (_writer != nullptr) {
+        _writer->flush();
+    }
 }
 
 void block_loader_cpio_cache::loadBlock(buffer_in_array& dest, uint32_t block_num)
 {
+    telemetry* t = telemetry::current();
+    auto start = chrono::steady_clock::now();
     if(loadBlockFromCache(dest, block_num)) {
+        if (t != nullptr) {
+            t->cache_hits++;
+            t->cache_read_ns.record(telemetry::elapsed_ns(start));
+        }
         return;
     } else {
-        _loader->loadBlock(dest, block_num);
+        if (t != nullptr) {
+            t->cache_misses++;
+        }
+
+        if (_writer != nullptr) {
+            auto block = make_shared<buffer_in_array>(dest.size());
+            _loader->loadBlock(*block, block_num);
+            share_items(*block, dest);
+            if (!_writer->write(blockFilename(block_num), block_num, block, _index) && t != nullptr) {
+                t->cache_writes_dropped++;
+            }
+            return;
+        }
 
+        _loader->loadBlock(dest, block_num);
         try {
+            start = chrono::steady_clock::now();
             writeBlockToCache(dest, block_num);
+            if (t != nullptr) {
+                t->cache_write_ns.record(telemetry::elapsed_ns(start));
+            }
+            if (_index != nullptr) {
+                uint32_t evicted = _index->add(blockFilename(block_num));
+                if (t != nullptr) {
+                    t->cache_evictions += evicted;
+                }
+            }
         } catch (std::exception& e) {
             // failure to write block to cache doesn't stop execution, only print an error
             cerr << "ERROR writing block to cache: " << e.what() << endl;
@@ -65,34 +145,58 @@ bool block_loader_cpio_cache::loadBlockFromCache(buffer_in_array& dest, uint32_t
 {
     // load a block from cpio cache into dest.  If file doesn't exist, return false.
     //  If loading from cpio cache was successful return true.
-    cpio::file_reader reader;
+    trace::span span("cache read", block_num);
+    string filename = blockFilename(block_num);
 
-    if(!reader.open(blockFilename(block_num))) {
-        // couldn't load the file
-        return false;
-    }
-    // load cpio file into dest one item at a time
-    for(int i=0; i < reader.itemCount(); ++i) {
-        for (auto d : dest) {
-            try {
-                reader.read(*d);
-            } catch (std::exception& e) {
-                d->add_exception(std::current_exception());
-            }
+    // a block still waiting to be written is as good as cached
+    if (_writer != nullptr) {
+        if (auto block = _writer->pending(filename)) {
+            share_items(*block, dest);
+            return true;
         }
     }
 
+    // the items are handed out as views of the mapped file where possible,
+    // which saves copying them
+    cpio::mmap_reader mapped;
+    if(mapped.open(filename)) {
+        read_items(mapped, dest);
+        touchBlock(filename);
+        return true;
+    }
+
+    cpio::file_reader reader;
+    if(!reader.open(filename)) {
+        // couldn't load the file
+        return false;
+    }
+    read_items(reader, dest);
     reader.close();
+    touchBlock(filename);
 
     // cpio file was read successfully, no need to hit primary data
     // source
     return true;
 }
 
+void block_loader_cpio_cache::touchBlock(const string& filename)
+{
+    if (_index == nullptr) {
+        return;
+    }
+    try {
+        _index->touch(filename);
+    } catch (std::exception& e) {
+        // the block was read, so this only costs it its place in the lru order
+        cerr << "ERROR updating cache index: " << e.what() << endl;
+    }
+}
+
 void block_loader_cpio_cache::writeBlockToCache(buffer_in_array& buff, uint32_t block_num)
 {
+    trace::span span("cache write", block_num);
     cpio::file_writer writer;
-    writer.open(blockFilename(block_num));
+    writer.open(blockFilename(block_num), "", true);
     writer.write_all_records(buff);
     writer.close();
 }
@@ -109,6 +213,12 @@ void block_loader_cpio_cache::invalidateOldCache(const string& rootCacheDir,
         while((ent = readdir(dir)) != NULL) {
             if(filenameHoldsInvalidCache(ent->d_name, cache_id, version)) {
                 removeDirectory(rootCacheDir + "/" + ent->d_name);
+                if (_index != nullptr) {
+                    _index->remove_directory(rootCacheDir + "/" + ent->d_name);
+                }
+            } else if(ent->d_name == cache_id + "_" + version) {
+                // left behind by writers which died part way through a block
+                cpio::file_writer::remove_stale_temp_files(rootCacheDir + "/" + ent->d_name);
             }
         }
         closedir(dir);
@@ -184,6 +294,12 @@ string block_loader_cpio_cache::blockFilename(uint32_t block_num)
      return _cacheDir + "/" + to_string(block_num) + "-" + to_string(_block_size) + ".cpio";
 }
 
+bool block_loader_cpio_cache::isCached(uint32_t block_num)
+{
+    // blocks are renamed into place once written, so a file that exists is whole
+    return access(blockFilename(block_num).c_str(), F_OK) == 0;
+}
+
 uint32_t block_loader_cpio_cache::objectCount()
 {
     return _loader->objectCount();
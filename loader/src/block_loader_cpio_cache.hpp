@@ -18,6 +18,7 @@
 #include <string>
 
 #include "block_loader_file.hpp"
+#include "cache_writer.hpp"
 
 /* block_loader_cpio_cache
  *
@@ -28,6 +29,20 @@
  * is used to help invalidate old versions of the same dataset.  If a cache is
  * created with the same cache_id as an existing cache, but a different version,
  * old version is deleted.
+ *
+ * Cached blocks are read through a cpio::mmap_reader where possible, so their
+ * items are views of the mapped cache file rather than copies.
+ *
+ * Blocks which miss the cache are written to it by the shared cache_writer,
+ * which holds up to `write_depth` blocks, rather than on the thread loading
+ * them.  Such a block is loaded into buffers of its own, which `dest` shares
+ * items from, so it stays intact until written.  A block which doesn't fit
+ * in the writer's queue isn't cached this time.  With a `write_depth` of 0
+ * blocks are written before loadBlock() returns.
+ *
+ * With a `size_limit` in bytes, the blocks of every cache under
+ * `rootCacheDir` are kept within it by a cache_index, which evicts the
+ * blocks used least recently.
  */
 
 namespace nervana {
@@ -38,15 +53,21 @@ class nervana::block_loader_cpio_cache : public block_loader {
 public:
     block_loader_cpio_cache(const std::string& rootCacheDir,
                             const std::string& cache_id, const std::string& version,
-                            std::shared_ptr<block_loader> loader);
+                            std::shared_ptr<block_loader> loader, int write_depth = 4,
+                            uint64_t size_limit = 0);
+    ~block_loader_cpio_cache();
 
     void loadBlock(nervana::buffer_in_array& dest, uint32_t block_num);
     uint32_t objectCount();
 
+    // the cpio file which holds block `block_num` once it is cached
+    std::string blockFilename(uint32_t block_num);
+    bool isCached(uint32_t block_num);
+
 private:
     bool loadBlockFromCache(nervana::buffer_in_array& dest, uint32_t block_num);
     void writeBlockToCache(nervana::buffer_in_array& dest, uint32_t block_num);
-    std::string blockFilename(uint32_t block_num);
+    void touchBlock(const std::string& filename);
 
     void invalidateOldCache(const std::string& rootCacheDir, const std::string& cache_id, const std::string& version);
     bool filenameHoldsInvalidCache(const std::string& filename, const std::string& cache_id, const std::string& version);
@@ -56,4 +77,6 @@ private:
 
     std::string _cacheDir;
     std::shared_ptr<block_loader> _loader;
+    std::shared_ptr<cache_writer> _writer;
+    std::shared_ptr<cache_index> _index;
 };
@@ -32,8 +32,7 @@ size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream)
     // callback used by curl.  writes data from ptr into the
     // stringstream passed in to `stream`.
 
-    string data((const char*) ptr, (size_t) size * nmemb);
-    *((stringstream*) stream) << data;
+    ((stringstream*) stream)->write((const char*) ptr, size * nmemb);
     return size * nmemb;
 }
 
@@ -27,47 +27,162 @@ using namespace std;
 using namespace nervana;
 
 void buffer_in::reset() {
-    buffers.clear();
+    // Keep the largest chunk of our own which no other buffer shares.  A
+    // shared chunk is left to whoever drops the last reference to it.
+    for (auto& c : _chunks) {
+        if (c->owner == this && c.use_count() == 1 &&
+            (_spare == nullptr || c->capacity > _spare->capacity)) {
+            _spare = c;
+        }
+    }
+    _chunks.clear();
+    _items.clear();
+    exceptions.clear();
+    _order = nullptr;
+
+    _tail     = -1;
+    _tailUsed = 0;
+    if (_used > 0) {
+        _lastUsed = _used;
+    }
+    _used     = 0;
 }
 
-void buffer_in::shuffle(uint32_t random_seed) {
-    std::minstd_rand0 rand_items(random_seed);
-    std::shuffle(buffers.begin(), buffers.end(), rand_items);
+int buffer_in::stored_index(int index) const {
+    // items added after the shuffle come last, in the order they were added
+    if (_order != nullptr && index < (int) _order->size()) {
+        return (*_order)[index];
+    }
+    return index;
 }
 
-vector<char>& buffer_in::get_item(int index) {
-    if (index >= (int) buffers.size()) {
+item_span buffer_in::get_item(int index) {
+    if (index >= (int) _items.size()) {
         throw invalid_argument("index out-of-range");
     }
 
+    index = stored_index(index);
     auto it = exceptions.find(index);
     if (it != exceptions.end()) {
         std::rethrow_exception(it->second);
     }
 
-    return buffers[index];
+    const item& i = _items[index];
+    return item_span(i.data, i.size);
 }
 
-void buffer_in::add_item(const std::vector<char>& buf) {
-    buffers.push_back(buf);
+uint32_t buffer_in::chunk_index(const shared_ptr<chunk>& c) {
+    // items added in a row nearly always share a chunk, and there are only
+    // ever a few chunks
+    for (int i = _chunks.size() - 1; i >= 0; i--) {
+        if (_chunks[i] == c) {
+            return i;
+        }
+    }
+    _chunks.push_back(c);
+    return _chunks.size() - 1;
+}
+
+char* buffer_in::append(size_t size) {
+    if (size == 0) {
+        _items.push_back({nullptr, 0, no_chunk});
+        return nullptr;
+    }
+
+    if (_tail < 0 || _tailUsed + size > _chunks[_tail]->capacity) {
+        // enough for everything the last block needed, and doubling from
+        // there if this one needs more
+        size_t capacity = std::max({size, _used, _lastUsed, (size_t)4096});
+        shared_ptr<chunk> c;
+        if (_spare != nullptr && _spare->capacity >= capacity) {
+            c = std::move(_spare);
+        } else {
+            c = make_shared<chunk>(this, capacity);
+        }
+        _spare    = nullptr;
+        _tail     = chunk_index(c);
+        _tailUsed = 0;
+    }
+
+    char* dest = _chunks[_tail]->data + _tailUsed;
+    _items.push_back({dest, size, (uint32_t)_tail});
+    _tailUsed += size;
+    _used     += size;
+    return dest;
+}
+
+void buffer_in::add_item(const char* data, size_t size) {
+    char* dest = append(size);
+    if (size > 0) {
+        memcpy(dest, data, size);
+    }
+}
+
+void buffer_in::add_view(const shared_ptr<void>& memory, char* data, size_t size) {
+    if (size == 0) {
+        append(0);
+        return;
+    }
+
+    // the items of a block nearly always come from the same memory
+    for (int i = _chunks.size() - 1; i >= 0; i--) {
+        if (_chunks[i]->memory == memory) {
+            _items.push_back({data, size, (uint32_t)i});
+            return;
+        }
+    }
+    _chunks.push_back(make_shared<chunk>(memory));
+    _items.push_back({data, size, (uint32_t)(_chunks.size() - 1)});
+}
+
+void buffer_in::share_item(buffer_in& src, int index) {
+    // throws if the item is an exception
+    src.get_item(index);
+
+    const item& i = src._items[src.stored_index(index)];
+    uint32_t chunk = i.chunk == no_chunk ? no_chunk : chunk_index(src._chunks[i.chunk]);
+    _items.push_back({i.data, i.size, chunk});
 }
 
 void buffer_in::add_exception(std::exception_ptr e) {
     // add an axception to exceptions
-    exceptions[buffers.size()] = e;
+    exceptions[_items.size()] = e;
 
-    // also add an empty vector to buffers to that indicies line up
-    std::vector<char> empty;
-    buffers.push_back(empty);
+    // also add an empty item so that indicies line up
+    append(0);
 }
 
 int buffer_in::get_item_count() {
-    return buffers.size();
+    return _items.size();
 }
 
 void buffer_in::read(istream& is, int size) {
-    // read `size` bytes out of `ifs` and push into buffer
-    vector<char> b(size);
-    is.read(b.data(), size);
-    buffers.push_back(b);
+    // read `size` bytes out of `is` straight into the buffer
+    is.read(append(size), size);
+}
+
+void buffer_in_array::shuffle(uint32_t random_seed) {
+    if (data.empty()) {
+        return;
+    }
+
+    // Shuffle the current order, so that shuffling twice is the same as
+    // shuffling the items themselves twice.
+    buffer_in* first = data[0];
+    for (auto b : data) {
+        if (b->get_item_count() != first->get_item_count()) {
+            throw runtime_error("every buffer of a buffer_in_array must hold the same number of items");
+        }
+    }
+
+    auto order = make_shared<vector<uint32_t>>(first->get_item_count());
+    for (size_t i = 0; i < order->size(); i++) {
+        (*order)[i] = first->stored_index(i);
+    }
+    std::minstd_rand0 rand_items(random_seed);
+    std::shuffle(order->begin(), order->end(), rand_items);
+
+    for (auto b : data) {
+        b->_order = order;
+    }
 }
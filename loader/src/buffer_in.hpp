@@ -22,12 +22,66 @@
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <cstdint>
 
 namespace nervana {
+    class item_span;
     class buffer_in;
     class buffer_in_array;
 }
 
+/* item_span
+ *
+ * A view of the bytes of one item in a buffer_in.  It doesn't own the bytes.
+ */
+class nervana::item_span {
+public:
+    item_span() {}
+    item_span(char* data, size_t size) : _data(data), _size(size) {}
+
+    char*  data() const { return _data; }
+    size_t size() const { return _size; }
+    bool   empty() const { return _size == 0; }
+    char*  begin() const { return _data; }
+    char*  end() const { return _data + _size; }
+    char&  operator[](size_t i) const { return _data[i]; }
+
+private:
+    char*   _data = nullptr;
+    size_t  _size = 0;
+};
+
+/* buffer_in
+ *
+ * A list of encoded items, e.g. the datums of a block.  The bytes of the
+ * items are stored back to back in reference counted chunks of memory
+ * rather than one allocation per item, and read() writes straight into
+ * them.
+ *
+ * share_item() adds an item of another buffer_in without copying it, by
+ * taking a reference to the chunk it lives in.  This is how minibatches
+ * are cut out of a block.
+ *
+ * add_view() adds an item which points into memory the buffer doesn't own,
+ * e.g. a mapped cpio file, keeping a reference to that memory for as long
+ * as any buffer holds the item.
+ *
+ * reset() keeps the largest chunk the buffer allocated itself for the next
+ * block, unless another buffer still shares it.  A chunk which is shared is
+ * only freed, and never overwritten, so it stays valid until every buffer
+ * sharing it has been reset.  Chunks are sized from how much the previous
+ * block needed, so a buffer which is reused settles on a single chunk.
+ *
+ * An item_span returned by get_item() is valid until the buffer is reset.
+ *
+ * Items are read in the order set by buffer_in_array::shuffle(), if any.
+ * Exceptions stay with the item they were added for.
+ *
+ * reset() tells whether a chunk is still shared from its reference count,
+ * so a buffer and every buffer it shares items with must only be filled and
+ * reset from one thread at a time.  Any thread may read items.
+ */
 class nervana::buffer_in {
 public:
     buffer_in() {}
@@ -35,22 +89,67 @@ public:
 
     void read(std::istream& is, int size);
     void reset();
-    std::vector<char>& get_item(int index);
-    void add_item(const std::vector<char>&);
+    item_span get_item(int index);
+    void add_item(const char* data, size_t size);
+    void add_item(const std::vector<char>& buf) { add_item(buf.data(), buf.size()); }
+    // adds `size` bytes at `data`, which lie within `memory`, without copying them
+    void add_view(const std::shared_ptr<void>& memory, char* data, size_t size);
     void add_exception(std::exception_ptr);
 
-    void shuffle(uint32_t random_seed);
+    // adds item `index` of `src` without copying it
+    void share_item(buffer_in& src, int index);
 
     int get_item_count();
 
 private:
-    std::vector<std::vector<char>> buffers;
-    std::map<int, std::exception_ptr> exceptions;
+    friend class buffer_in_array;
+    buffer_in(const buffer_in&) = delete;
+
+    struct chunk {
+        chunk(const buffer_in* o, size_t n) : owner(o), storage(new char[n]), data(storage.get()), capacity(n) {}
+        // memory owned elsewhere, which is never appended to or reused
+        chunk(const std::shared_ptr<void>& m) : owner(nullptr), memory(m), data(nullptr), capacity(0) {}
+        const buffer_in*            owner;
+        std::unique_ptr<char[]>     storage;
+        std::shared_ptr<void>       memory;
+        char*                       data;
+        size_t                      capacity;
+    };
+
+    struct item {
+        char*       data;
+        size_t      size;
+        uint32_t    chunk;      // index into _chunks, or no_chunk if empty
+    };
+    static const uint32_t no_chunk = UINT32_MAX;
+
+    // adds an item of `size` bytes and returns where to write them
+    char*    append(size_t size);
+    uint32_t chunk_index(const std::shared_ptr<chunk>& c);
+    // where item `index` is stored, given the order
+    int      stored_index(int index) const;
+
+    std::vector<std::shared_ptr<chunk>> _chunks;    // every chunk an item is in
+    std::shared_ptr<chunk>      _spare;             // kept by reset() for reuse
+    int                         _tail       = -1;   // the chunk append() fills
+    size_t                      _tailUsed   = 0;
+    size_t                      _used       = 0;    // bytes appended since reset()
+    size_t                      _lastUsed   = 0;    // by the last block appended
+    std::vector<item>           _items;
+    std::map<int, std::exception_ptr> exceptions;     // by stored index
+
+    // shared by every buffer of the buffer_in_array which shuffled it
+    std::shared_ptr<const std::vector<uint32_t>> _order;
 };
 
 // buffer_in_array holds a vector of buffer_in*.  Each buffer_in* holds one component
 // of a particular record (i.e. datum, target, meta, etc).
 // Each buffer_in* should have the same length.
+//
+// shuffle() reorders the records without moving any items.  It draws one
+// permutation of the records, which every buffer then reads its items
+// through, so the components of a record stay together.  The order lasts
+// until the buffers are reset.
 class nervana::buffer_in_array {
 public:
     buffer_in_array(unsigned int nbuffers_in)
@@ -73,6 +172,11 @@ public:
     const buffer_in* operator[](int i) const { return data[i]; }
     size_t size() const { return data.size(); }
 
+    // exchange the underlying buffers with `other` without copying any items
+    void swap(buffer_in_array& other) { data.swap(other.data); }
+
+    void shuffle(uint32_t random_seed);
+
     std::vector<buffer_in*>::iterator begin() { return data.begin(); }
     std::vector<buffer_in*>::iterator end() { return data.end(); }
 
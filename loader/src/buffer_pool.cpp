@@ -13,26 +13,148 @@
  limitations under the License.
 */
 
+#include <thread>
+
 #include "buffer_pool.hpp"
+#include "util.hpp"
+#include "trace.hpp"
 
+using namespace std;
 using namespace nervana;
 
-buffer_pool::buffer_pool() {
-    _exceptions.push_back(nullptr);
-    _exceptions.push_back(nullptr);
+buffer_pool::buffer_pool(int count)
+: _count(count)
+{
+    affirm(_count > 0, "buffer pool depth must be > 0");
+    _exceptions.resize(_count, nullptr);
 }
 
 void buffer_pool::write_exception(std::exception_ptr exception_ptr) {
-    _exceptions[_writePos] = exception_ptr;
-}
-
-void buffer_pool::clear_exception() {
-    _exceptions[_writePos] = nullptr;
+    _exceptions[write_index()] = exception_ptr;
 }
 
 void buffer_pool::reraise_exception() {
-    if(auto e = _exceptions[_readPos]) {
-        clear_exception();
+    if(auto e = _exceptions[read_index()]) {
+        _exceptions[read_index()] = nullptr;
         std::rethrow_exception(e);
     }
 }
+
+int buffer_pool::read_index()
+{
+    return _read_count.load(memory_order_relaxed) % _count;
+}
+
+int buffer_pool::write_index()
+{
+    return _write_count.load(memory_order_relaxed) % _count;
+}
+
+void buffer_pool::advance_read_pos()
+{
+    // the slot is recycled, so forget anything which was raised for it
+    _exceptions[read_index()] = nullptr;
+    _read_count++;
+    notify(_nonFull);
+}
+
+void buffer_pool::advance_write_pos()
+{
+    _write_count++;
+    notify(_nonEmpty);
+}
+
+int buffer_pool::used()
+{
+    return _write_count.load() - _read_count.load();
+}
+
+bool buffer_pool::empty()
+{
+    return _write_count.load() == _read_count.load();
+}
+
+bool buffer_pool::full()
+{
+    return used() >= _count;
+}
+
+bool buffer_pool::wait_for_not_empty()
+{
+    return wait(_nonEmpty, [this]() { return !empty(); }, "wait not empty");
+}
+
+bool buffer_pool::wait_for_not_full()
+{
+    return wait(_nonFull, [this]() { return !full(); }, "wait not full");
+}
+
+bool buffer_pool::wait_for_readable(uint64_t pos)
+{
+    return wait(_nonEmpty, [this, pos]() { return _write_count.load() > pos; }, "wait readable");
+}
+
+bool buffer_pool::wait_for_writable(uint64_t pos)
+{
+    return wait(_nonFull, [this, pos]() { return _read_count.load() + _count > pos; }, "wait writable");
+}
+
+std::exception_ptr buffer_pool::get_exception(uint64_t pos)
+{
+    return _exceptions[index(pos)];
+}
+
+void buffer_pool::shutdown()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _shutdown = true;
+    }
+    _nonFull.notify_all();
+    _nonEmpty.notify_all();
+}
+
+void buffer_pool::reset()
+{
+    _read_count = 0;
+    _write_count = 0;
+    for (auto& e : _exceptions) {
+        e = nullptr;
+    }
+    _shutdown = false;
+}
+
+bool buffer_pool::wait(condition_variable& cond, const function<bool()>& ready, const char* name)
+{
+    if (_shutdown || ready()) {
+        return !_shutdown;
+    }
+
+    // only waits which don't succeed straight away show up in a trace
+    trace::span span(name);
+    for (int i = 0; i < _spin_count && !_shutdown && !ready(); i++) {
+        this_thread::yield();
+    }
+    if (!_shutdown && !ready()) {
+        unique_lock<mutex> lock(_mutex);
+        _waiters++;
+        while (!_shutdown && !ready()) {
+            cond.wait(lock);
+        }
+        _waiters--;
+    }
+    return !_shutdown;
+}
+
+void buffer_pool::notify(condition_variable& cond)
+{
+    // Only pay for the mutex when somebody is actually blocked.  Taking the
+    // mutex before notifying guarantees that a waiter which registered
+    // itself has either seen the new cursor value or is already waiting.
+    if (_waiters.load() > 0) {
+        {
+            lock_guard<mutex> lock(_mutex);
+        }
+        cond.notify_all();
+    }
+}
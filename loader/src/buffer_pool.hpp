@@ -16,24 +16,89 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 
 namespace nervana {
     class buffer_pool;
 }
 
-/* Base class buffer_pool only deals in exception handling for now */
+/* buffer_pool
+ *
+ * Base class for the fixed depth rings of buffers which connect the reader,
+ * the decoder and the consumer.  Each pool has exactly one producer and one
+ * consumer thread, so the read and write cursors are plain atomic counters
+ * and the common case of handing over a buffer takes no lock.  A thread that
+ * finds the pool empty (or full) spins briefly and then falls back to
+ * blocking on a condition variable.
+ *
+ * Exceptions raised while producing a buffer are stored with the buffer and
+ * re-raised when the consumer reads it.
+ *
+ * Buffers can also be addressed by their absolute position, the number of
+ * buffers written to the pool before them.  This lets a consumer keep
+ * several buffers in flight at once.
+ *
+ * shutdown() wakes every thread blocked on the pool, and from then on all of
+ * the wait functions return false straight away.  reset() discards whatever
+ * is in the pool and opens it again.
+ */
 
 class nervana::buffer_pool {
 protected:
-    buffer_pool();
+    buffer_pool(int count);
 public:
+    virtual ~buffer_pool() {}
+
     void write_exception(std::exception_ptr exception_ptr);
     void reraise_exception();
 
+    void advance_read_pos();
+    void advance_write_pos();
+    bool empty();
+    bool full();
+    int  used();
+    int  size() { return _count; }
+    // the wait functions return false if the pool was shut down
+    bool wait_for_not_empty();
+    bool wait_for_not_full();
+
+    uint64_t read_pos() { return _read_count.load(); }
+    uint64_t write_pos() { return _write_count.load(); }
+    // wait until the buffer at `pos` has been written
+    bool wait_for_readable(uint64_t pos);
+    // wait until the buffer at `pos` may be written
+    bool wait_for_writable(uint64_t pos);
+    std::exception_ptr get_exception(uint64_t pos);
+
+    void shutdown();
+    bool is_shutdown() { return _shutdown.load(); }
+    // must only be called while no other thread is using the pool
+    void reset();
+
 protected:
-    void clear_exception();
+    int  read_index();
+    int  write_index();
+    int  index(uint64_t pos) { return pos % _count; }
+    bool wait(std::condition_variable& cond, const std::function<bool()>& ready, const char* name);
+    void notify(std::condition_variable& cond);
 
+    const int                       _count;
     std::vector<std::exception_ptr> _exceptions;
-    int                             _readPos = 0;
-    int                             _writePos = 0;
+
+    // both counters only ever increase.  The slot index is the counter
+    // modulo _count.
+    std::atomic<uint64_t>           _read_count{0};
+    std::atomic<uint64_t>           _write_count{0};
+    std::atomic<int>                _waiters{0};
+    std::atomic<bool>               _shutdown{false};
+
+    std::mutex                      _mutex;
+    std::condition_variable         _nonFull;
+    std::condition_variable         _nonEmpty;
+
+    static constexpr int            _spin_count = 64;
 };
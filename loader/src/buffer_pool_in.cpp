@@ -31,8 +31,8 @@
 using namespace std;
 using namespace nervana;
 
-buffer_pool_in::buffer_pool_in(unsigned int nbuffers_in)
-: buffer_pool()
+buffer_pool_in::buffer_pool_in(unsigned int nbuffers_in, int count)
+: buffer_pool(count), _nbuffers_in(nbuffers_in)
 {
     for (int i = 0; i < _count; i++) {
         _bufs.push_back(make_shared<buffer_in_array>(nbuffers_in));
@@ -44,7 +44,7 @@ buffer_pool_in::~buffer_pool_in() {}
 
 buffer_in_array& buffer_pool_in::get_for_write()
 {
-    buffer_in_array& buf_ary = *_bufs[_writePos];
+    buffer_in_array& buf_ary = *_bufs[write_index()];
     for (auto &b : buf_ary) {
         b->reset();
     }
@@ -54,64 +54,15 @@ buffer_in_array& buffer_pool_in::get_for_write()
 buffer_in_array& buffer_pool_in::get_for_read()
 {
     reraise_exception();
-    return *_bufs[_readPos];
+    return *_bufs[read_index()];
 }
 
-void buffer_pool_in::advance_read_pos()
+unsigned int buffer_pool_in::get_buffer_count()
 {
-    _used--;
-    advance(_readPos);
+    return _nbuffers_in;
 }
 
-void buffer_pool_in::advance_write_pos()
+buffer_in_array& buffer_pool_in::get(uint64_t pos)
 {
-    _used++;
-    advance(_writePos);
-    clear_exception();
+    return *_bufs[index(pos)];
 }
-
-bool buffer_pool_in::empty()
-{
-    affirm(_used >= 0, "buffer_pool_in used < 0");
-    return (_used == 0);
-}
-
-bool buffer_pool_in::full()
-{
-    affirm(_used <= _count, "buffer_pool_in used > count");
-    return (_used == _count);
-}
-
-std::mutex& buffer_pool_in::get_mutex()
-{
-    return _mutex;
-}
-
-void buffer_pool_in::wait_for_not_empty(std::unique_lock<std::mutex>& lock)
-{
-    _nonEmpty.wait(lock);
-}
-
-void buffer_pool_in::wait_for_non_full(std::unique_lock<std::mutex>& lock)
-{
-    _nonFull.wait(lock);
-}
-
-void buffer_pool_in::signal_not_empty()
-{
-    _nonEmpty.notify_all();
-}
-
-void buffer_pool_in::signal_not_full()
-{
-    _nonFull.notify_all();
-}
-
-void buffer_pool_in::advance(int& index)
-{
-    // increment index and reset to 0 when index hits `_count`
-    if (++index == _count) {
-        index = 0;
-    }
-}
-
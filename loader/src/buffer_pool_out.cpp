@@ -32,8 +32,8 @@ using namespace std;
 using namespace nervana;
 
 buffer_pool_out::buffer_pool_out(const std::vector<size_t>& writeSizes,
-                                 size_t batchSize, bool pinned)
-: buffer_pool()
+                                 size_t batchSize, bool pinned, int count)
+: buffer_pool(count)
 {
     for (int i = 0; i < _count; i++) {
         _bufs.push_back(make_shared<buffer_out_array>(writeSizes, batchSize, pinned));
@@ -48,69 +48,15 @@ buffer_pool_out::~buffer_pool_out()
 
 buffer_out_array& buffer_pool_out::get_for_write()
 {
-    return *_bufs[_writePos];
+    return *_bufs[write_index()];
 }
 
 buffer_out_array& buffer_pool_out::get_for_read()
 {
-    return *_bufs[_readPos];
+    return *_bufs[read_index()];
 }
 
-void buffer_pool_out::advance_read_pos()
+buffer_out_array& buffer_pool_out::get(uint64_t pos)
 {
-    _used--;
-    advance(_readPos);
+    return *_bufs[index(pos)];
 }
-
-void buffer_pool_out::advance_write_pos()
-{
-    _used++;
-    advance(_writePos);
-    clear_exception();
-}
-
-bool buffer_pool_out::empty()
-{
-    affirm(_used >= 0, "buffer_pool_out used < 0");
-    return (_used == 0);
-}
-
-bool buffer_pool_out::full()
-{
-    affirm(_used <= _count, "buffer_pool_out used > count");
-    return (_used == _count);
-}
-
-std::mutex& buffer_pool_out::get_mutex()
-{
-    return _mutex;
-}
-
-void buffer_pool_out::wait_for_not_empty(std::unique_lock<std::mutex>& lock)
-{
-    _nonEmpty.wait(lock);
-}
-
-void buffer_pool_out::wait_for_non_full(std::unique_lock<std::mutex>& lock)
-{
-    _nonFull.wait(lock);
-}
-
-void buffer_pool_out::signal_not_empty()
-{
-    _nonEmpty.notify_all();
-}
-
-void buffer_pool_out::signal_not_full()
-{
-    _nonFull.notify_all();
-}
-
-void buffer_pool_out::advance(int& index)
-{
-    // increment index and reset to 0 when index hits `_count`
-    if (++index == _count) {
-        index = 0;
-    }
-}
-
@@ -16,8 +16,7 @@
 #pragma once
 
 #include <vector>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
 #include <cstring>
 
 #include "buffer_pool.hpp"
@@ -27,32 +26,17 @@ namespace nervana {
     class buffer_pool_out;
 }
 
-// buffer_pool_out acts as our double buffer to hold data before copying to device
+// buffer_pool_out holds decoded minibatches before they are copied to device.
+// The default depth of 2 gives double buffering.
 class nervana::buffer_pool_out : public nervana::buffer_pool {
 public:
-    buffer_pool_out(const std::vector<size_t>& writeSizes, size_t batchSize, bool pinned = false);
+    buffer_pool_out(const std::vector<size_t>& writeSizes, size_t batchSize,
+                    bool pinned = false, int count = 2);
     virtual ~buffer_pool_out();
     buffer_out_array& get_for_write();
     buffer_out_array& get_for_read();
-
-    void advance_read_pos();
-    void advance_write_pos();
-    bool empty();
-    bool full();
-    std::mutex& get_mutex();
-    void wait_for_not_empty(std::unique_lock<std::mutex>& lock);
-    void wait_for_non_full(std::unique_lock<std::mutex>& lock);
-    void signal_not_empty();
-    void signal_not_full();
-
-protected:
-    void advance(int& index);
+    buffer_out_array& get(uint64_t pos);
 
 protected:
-    static constexpr int        _count = 2;
-    int                         _used = 0;
     std::vector<std::shared_ptr<buffer_out_array>> _bufs;
-    std::mutex                  _mutex;
-    std::condition_variable     _nonFull;
-    std::condition_variable     _nonEmpty;
 };
@@ -0,0 +1,306 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "cache_index.hpp"
+#include "cpio.hpp"
+
+using namespace std;
+using namespace nervana;
+
+const char* cache_index::index_filename = "aeon_cache_index";
+
+namespace {
+    bool ends_with(const string& s, const string& suffix)
+    {
+        return s.size() >= suffix.size() &&
+               s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+cache_index::cache_index(const string& root, uint64_t budget)
+: _root(root), _budget(budget), _last_update(now())
+{
+}
+
+cache_index::~cache_index()
+{
+    {
+        lock_guard<mutex> lock(_touched_mutex);
+        if (_touched.empty()) {
+            return;
+        }
+    }
+    try {
+        update([](entry_map&) { return false; });
+    } catch (std::exception& e) {
+        // the reads are only lost from the lru order
+        cerr << "ERROR updating cache index: " << e.what() << endl;
+    }
+}
+
+uint32_t cache_index::add(const string& filename)
+{
+    struct stat stats;
+    if (stat(filename.c_str(), &stats) != 0) {
+        throw runtime_error("error adding " + filename + " to cache index: " + strerror(errno));
+    }
+
+    uint32_t evicted = 0;
+    string   name    = relative(filename);
+    update([&](entry_map& entries) {
+        entries[name] = {now(), (uint64_t)stats.st_size};
+
+        uint64_t total = 0;
+        vector<entry_map::iterator> lru;
+        for (auto it = entries.begin(); it != entries.end(); it++) {
+            total += it->second.size;
+            if (it->first != name) {
+                lru.push_back(it);
+            }
+        }
+        if (total <= _budget) {
+            return true;
+        }
+
+        sort(lru.begin(), lru.end(), [](const entry_map::iterator& a, const entry_map::iterator& b) {
+            return a->second.last_used < b->second.last_used;
+        });
+        for (auto it : lru) {
+            if (total <= _budget) {
+                break;
+            }
+            // a reader which has the block open or mapped keeps it until
+            // it is done
+            if (unlink((_root + "/" + it->first).c_str()) == 0) {
+                evicted++;
+            } else if (errno != ENOENT) {
+                continue;
+            }
+            total -= it->second.size;
+            entries.erase(it);
+        }
+        return true;
+    });
+    return evicted;
+}
+
+void cache_index::touch(const string& filename)
+{
+    string name = relative(filename);
+    {
+        lock_guard<mutex> lock(_touched_mutex);
+        uint64_t          t = now();
+        _touched[name]      = t;
+        if (_touched.size() < touch_batch && t - _last_update < touch_interval * 1000000000ull) {
+            return;
+        }
+    }
+    update([](entry_map&) { return false; });
+}
+
+void cache_index::remove_directory(const string& dir)
+{
+    string prefix = relative(dir) + "/";
+    update([&](entry_map& entries) {
+        auto begin = entries.lower_bound(prefix);
+        auto end   = begin;
+        while (end != entries.end() && end->first.compare(0, prefix.size(), prefix) == 0) {
+            end++;
+        }
+        if (begin == end) {
+            return false;
+        }
+        entries.erase(begin, end);
+        return true;
+    });
+}
+
+uint64_t cache_index::size()
+{
+    uint64_t total = 0;
+    update([&](entry_map& entries) {
+        for (auto& e : entries) {
+            total += e.second.size;
+        }
+        return false;
+    });
+    return total;
+}
+
+void cache_index::update(const function<bool(entry_map&)>& f)
+{
+    // The lock is taken on the root directory rather than the index, since
+    // the index is replaced by renaming a new one over it.
+    int fd = open(_root.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        throw runtime_error("error opening cache directory " + _root + ": " + strerror(errno));
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            throw runtime_error("error locking cache directory " + _root + ": " + strerror(errno));
+        }
+    }
+
+    try {
+        entry_map entries;
+        bool      changed = false;
+        if (!load(entries)) {
+            scan(entries);
+            changed = true;
+        }
+        changed = merge_touched(entries) || changed;
+        changed = f(entries) || changed;
+        if (changed) {
+            save(entries);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    // closing the directory releases the lock
+    close(fd);
+}
+
+bool cache_index::merge_touched(entry_map& entries)
+{
+    map<string, uint64_t> touched;
+    {
+        lock_guard<mutex> lock(_touched_mutex);
+        touched.swap(_touched);
+        _last_update = now();
+    }
+
+    bool changed = false;
+    for (auto& t : touched) {
+        auto it = entries.find(t.first);
+        if (it != entries.end()) {
+            if (it->second.last_used < t.second) {
+                it->second.last_used = t.second;
+                changed              = true;
+            }
+            continue;
+        }
+
+        // written while no budget was set, or since evicted
+        struct stat stats;
+        if (stat((_root + "/" + t.first).c_str(), &stats) == 0) {
+            entries[t.first] = {t.second, (uint64_t)stats.st_size};
+            changed          = true;
+        }
+    }
+    return changed;
+}
+
+bool cache_index::load(entry_map& entries)
+{
+    // one line per block: last_used size name
+    ifstream in(_root + "/" + index_filename);
+    if (!in) {
+        return false;
+    }
+    string line;
+    while (getline(in, line)) {
+        stringstream ss(line);
+        entry        e;
+        string       name;
+        if (!(ss >> e.last_used >> e.size >> name)) {
+            entries.clear();
+            return false;
+        }
+        entries[name] = e;
+    }
+    return true;
+}
+
+void cache_index::save(const entry_map& entries)
+{
+    string filename = _root + "/" + index_filename;
+    string temp     = filename + ".tmp";
+    {
+        ofstream out(temp, ios::trunc);
+        for (auto& e : entries) {
+            out << e.second.last_used << " " << e.second.size << " " << e.first << "\n";
+        }
+        if (!out.flush()) {
+            throw runtime_error("error writing cache index " + temp);
+        }
+    }
+    if (rename(temp.c_str(), filename.c_str()) != 0) {
+        throw runtime_error("error renaming cache index " + temp + ": " + strerror(errno));
+    }
+}
+
+void cache_index::scan(entry_map& entries)
+{
+    // blocks are kept in a directory per dataset under the root
+    DIR* root = opendir(_root.c_str());
+    if (root == nullptr) {
+        throw runtime_error("error enumerating cache in " + _root);
+    }
+    struct dirent* ent;
+    while ((ent = readdir(root)) != nullptr) {
+        string dataset = ent->d_name;
+        if (dataset == "." || dataset == "..") {
+            continue;
+        }
+        DIR* dir = opendir((_root + "/" + dataset).c_str());
+        if (dir == nullptr) {
+            continue;
+        }
+        cpio::file_writer::remove_stale_temp_files(_root + "/" + dataset);
+        struct dirent* block;
+        while ((block = readdir(dir)) != nullptr) {
+            string      name = dataset + "/" + block->d_name;
+            struct stat stats;
+            if (ends_with(name, ".cpio") && stat((_root + "/" + name).c_str(), &stats) == 0) {
+                uint64_t mtime = stats.st_mtim.tv_sec * 1000000000ull + stats.st_mtim.tv_nsec;
+                entries[name] = {mtime, (uint64_t)stats.st_size};
+            }
+        }
+        closedir(dir);
+    }
+    closedir(root);
+}
+
+string cache_index::relative(const string& filename)
+{
+    if (filename.compare(0, _root.size() + 1, _root + "/") != 0) {
+        throw invalid_argument(filename + " is not in cache directory " + _root);
+    }
+    return filename.substr(_root.size() + 1);
+}
+
+uint64_t cache_index::now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,95 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <functional>
+
+namespace nervana {
+    class cache_index;
+}
+
+/* cache_index
+ *
+ * Keeps the cpio caches under `root` within `budget` bytes, across every
+ * dataset cached there.
+ *
+ * Every cached block is listed in an index file in `root` with its size and
+ * when it was last used.  When a block has been written and the blocks add
+ * up to more than the budget, the blocks used least recently are deleted,
+ * whichever dataset they belong to, until the rest fit.  The index is
+ * locked while it is updated, so loaders in several processes can share
+ * `root`.
+ *
+ * Reading a block doesn't lock the index.  Its last use is kept here and
+ * merged into the index with the others when a block is added, every
+ * `touch_batch` reads or `touch_interval` seconds, and when the cache_index
+ * is destroyed.  Until then other loaders may evict it as if it had not
+ * been read; one which has it open keeps it until it is done.
+ *
+ * A missing or unreadable index is rebuilt from the blocks found under
+ * `root`, taking their modification time as their last use.  The cache
+ * can go over budget by the blocks being written at the time.
+ */
+class nervana::cache_index {
+public:
+    cache_index(const std::string& root, uint64_t budget);
+    ~cache_index();
+
+    // records block `filename` as just written, and returns how many blocks
+    // were deleted to make room for it
+    uint32_t add(const std::string& filename);
+    // records block `filename` as just used
+    void touch(const std::string& filename);
+    // forgets the blocks in `dir`, which has been deleted
+    void remove_directory(const std::string& dir);
+    // bytes in all the blocks listed
+    uint64_t size();
+
+    static const char* index_filename;
+    static const size_t   touch_batch    = 64;
+    static const uint64_t touch_interval = 10;
+
+private:
+    cache_index() = delete;
+
+    struct entry {
+        uint64_t    last_used;
+        uint64_t    size;
+    };
+    // by path relative to _root
+    typedef std::map<std::string, entry> entry_map;
+
+    // calls f with the index locked, after merging the blocks touched since
+    // the last update, and saves the index if anything changed
+    void update(const std::function<bool(entry_map&)>& f);
+    bool merge_touched(entry_map& entries);
+    bool load(entry_map& entries);
+    void save(const entry_map& entries);
+    void scan(entry_map& entries);
+    std::string relative(const std::string& filename);
+    static uint64_t now();
+
+    const std::string   _root;
+    const uint64_t      _budget;
+
+    std::mutex                      _touched_mutex;
+    // last use by name, since the last update; guarded by _touched_mutex
+    std::map<std::string, uint64_t> _touched;
+    uint64_t                        _last_update;  // guarded by _touched_mutex
+};
@@ -0,0 +1,195 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "cache_warmer.hpp"
+#include "decode_executor.hpp"
+#include "loader.hpp"
+#include "manifest_nds.hpp"
+#include "provider_factory.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using namespace nervana;
+
+string cache_warmer::progress::str() const
+{
+    double mb = bytes_written / (1024. * 1024.);
+    stringstream ss;
+    ss << fixed << setprecision(1);
+    ss << blocks_done << "/" << block_count << " blocks";
+    if (blocks_skipped > 0) {
+        ss << ", " << blocks_skipped << " already cached";
+    }
+    if (blocks_failed > 0) {
+        ss << ", " << blocks_failed << " failed";
+    }
+    if (blocks_evicted > 0) {
+        ss << ", " << blocks_evicted << " evicted to stay within cache_size_mb";
+    }
+    ss << ", " << mb << " MB in " << seconds << " s";
+    if (seconds > 0) {
+        ss << " (" << mb / seconds << " MB/s)";
+    }
+    return ss.str();
+}
+
+cache_warmer::cache_warmer(const string& config)
+: _config(nlohmann::json::parse(config))
+{
+    loader_config lcfg(_config);
+    if (lcfg.cache_directory.empty()) {
+        throw invalid_argument("cache_directory must be set to warm the cache");
+    }
+    _cache = make_cache();
+
+    // blocks are cached with a buffer for each input of the provider, as
+    // the loader reads them
+    _nbuffers = provider_factory::create(_config)->num_inputs;
+}
+
+shared_ptr<block_loader_cpio_cache> cache_warmer::make_cache()
+{
+    loader_config lcfg(_config);
+    // each block is written out by the thread which loaded it
+    lcfg.cache_write_depth = 0;
+    return dynamic_pointer_cast<block_loader_cpio_cache>(loader::make_block_loader(lcfg));
+}
+
+cache_warmer::progress cache_warmer::run(int thread_count,
+                                         function<void(const progress&)> report,
+                                         int report_ms)
+{
+    uint32_t block_count = blockCount();
+    if (thread_count <= 0) {
+        thread_count = decode_executor::available_cpus();
+    }
+    thread_count = max(1, min(thread_count, (int)block_count));
+
+    // block_loader_nds fetches through a single curl handle, so each thread
+    // needs loaders of its own.  block_loader_file can be shared.
+    bool shared = !manifest_nds::is_likely_json(loader_config(_config).manifest_filename);
+    vector<shared_ptr<block_loader_cpio_cache>> caches;
+    for (int i = 0; i < thread_count; i++) {
+        caches.push_back(shared || i == 0 ? _cache : make_cache());
+    }
+
+    atomic<uint32_t>    next_block{0};
+    atomic<uint32_t>    done{0};
+    atomic<uint32_t>    skipped{0};
+    atomic<uint32_t>    failed{0};
+    atomic<uint64_t>    bytes{0};
+    // each block is only looked at by the thread which claimed it
+    vector<char>        failed_blocks(block_count, false);
+    mutex               m;
+    condition_variable  finished;
+    int                 running = thread_count;
+
+    auto work = [&](shared_ptr<block_loader_cpio_cache> cache) {
+        trace::set_thread_name("cache warmer");
+        // the cache only logs a failed write, and counts the ones which
+        // succeed in the current telemetry
+        telemetry         writes;
+        telemetry::scope  scope(&writes);
+        uint32_t block_num;
+        while ((block_num = next_block++) < block_count) {
+            if (cache->isCached(block_num)) {
+                skipped++;
+                done++;
+                continue;
+            }
+            uint64_t written = writes.cache_write_ns.count();
+            try {
+                buffer_in_array block(_nbuffers);
+                cache->loadBlock(block, block_num);
+            } catch (std::exception& e) {
+                cerr << "ERROR loading block " << block_num << ": " << e.what() << endl;
+            }
+
+            if (writes.cache_write_ns.count() == written) {
+                failed_blocks[block_num] = true;
+                failed++;
+            } else {
+                // unless another thread has evicted it already
+                struct stat stats;
+                if (stat(cache->blockFilename(block_num).c_str(), &stats) == 0) {
+                    bytes += stats.st_size;
+                }
+            }
+            done++;
+        }
+
+        lock_guard<mutex> lock(m);
+        if (--running == 0) {
+            finished.notify_all();
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    auto snapshot = [&]() {
+        progress p;
+        p.block_count    = block_count;
+        p.blocks_done    = done;
+        p.blocks_skipped = skipped;
+        p.blocks_failed  = failed;
+        p.bytes_written  = bytes;
+        p.seconds        = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return p;
+    };
+
+    vector<thread> threads;
+    for (auto& cache : caches) {
+        threads.emplace_back(work, cache);
+    }
+
+    {
+        unique_lock<mutex> lock(m);
+        while (!finished.wait_for(lock, chrono::milliseconds(report_ms),
+                                  [&]() { return running == 0; })) {
+            if (report) {
+                lock.unlock();
+                report(snapshot());
+                lock.lock();
+            }
+        }
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    progress rc = snapshot();
+    // blocks written early on make way for later ones once the budget is
+    // used up
+    for (uint32_t block_num = 0; block_num < block_count; block_num++) {
+        if (!failed_blocks[block_num] && !_cache->isCached(block_num)) {
+            rc.blocks_evicted++;
+        }
+    }
+    if (report) {
+        report(rc);
+    }
+    return rc;
+}
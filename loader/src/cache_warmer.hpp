@@ -0,0 +1,78 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "json.hpp"
+#include "block_loader_cpio_cache.hpp"
+
+namespace nervana {
+    class cache_warmer;
+}
+
+/* cache_warmer
+ *
+ * Fills the cpio cache of a loader config ahead of time, so that the first
+ * epoch of a job reads from the cache rather than from the dataset.  The
+ * cache is built by the same block loaders as the loader's, so it holds
+ * exactly the files a loader with `config` looks for.
+ *
+ * run() loads every block which isn't cached yet on `thread_count` threads
+ * and writes it out, and calls `report` from the calling thread every
+ * `report_ms` milliseconds and once more when done.  A warm-up which is
+ * stopped can be run again, since blocks already cached are skipped.
+ */
+class nervana::cache_warmer {
+public:
+    struct progress {
+        uint32_t block_count    = 0;
+        // blocks written or found in the cache so far
+        uint32_t blocks_done    = 0;
+        // of those, the ones which were already cached
+        uint32_t blocks_skipped = 0;
+        uint32_t blocks_failed  = 0;
+        // blocks done which were no longer cached at the end, because the
+        // cache_size_mb budget can't hold the whole dataset
+        uint32_t blocks_evicted = 0;
+        uint64_t bytes_written  = 0;
+        double   seconds        = 0;
+
+        // for logging, e.g. "120/500 blocks, 3 failed, 850.2 MB in 12.3 s (69.1 MB/s)"
+        std::string str() const;
+    };
+
+    explicit cache_warmer(const std::string& config);
+
+    uint32_t blockCount() { return _cache->blockCount(); }
+    // with a thread_count of 0 there is a thread per cpu
+    progress run(int thread_count,
+                 std::function<void(const progress&)> report = nullptr,
+                 int report_ms = 1000);
+
+private:
+    cache_warmer() = delete;
+    cache_warmer(const cache_warmer&) = delete;
+
+    std::shared_ptr<nervana::block_loader_cpio_cache> make_cache();
+
+    nlohmann::json                                      _config;
+    std::shared_ptr<nervana::block_loader_cpio_cache>   _cache;
+    int                                                 _nbuffers;
+};
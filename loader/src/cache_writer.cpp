@@ -0,0 +1,138 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <iostream>
+
+#include "cache_writer.hpp"
+#include "cpio.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+cache_writer::cache_writer(int depth)
+: _depth(depth)
+{
+    affirm(_depth > 0, "cache write queue depth must be > 0");
+    _thread = thread(&cache_writer::run, this);
+}
+
+cache_writer::~cache_writer()
+{
+    // whatever is queued is still written
+    {
+        lock_guard<mutex> lock(_mutex);
+        _done = true;
+    }
+    _queued.notify_all();
+    _thread.join();
+}
+
+shared_ptr<cache_writer> cache_writer::get(int depth)
+{
+    // The instance lives as long as some loader holds it, so its thread
+    // goes away with the last loader rather than at static destruction time.
+    static mutex                  instance_mutex;
+    static weak_ptr<cache_writer> instance;
+
+    lock_guard<mutex> lock(instance_mutex);
+    shared_ptr<cache_writer> rc = instance.lock();
+    if (rc == nullptr) {
+        rc = make_shared<cache_writer>(depth);
+        instance = rc;
+    }
+    return rc;
+}
+
+bool cache_writer::write(const string& filename, uint32_t block_num,
+                         const shared_ptr<buffer_in_array>& block,
+                         const shared_ptr<cache_index>& index)
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (auto& j : _jobs) {
+            if (j.filename == filename) {
+                return true;
+            }
+        }
+        if ((int)_jobs.size() >= _depth) {
+            return false;
+        }
+        _jobs.push_back({filename, block_num, block, index, telemetry::current()});
+    }
+    _queued.notify_one();
+    return true;
+}
+
+shared_ptr<buffer_in_array> cache_writer::pending(const string& filename)
+{
+    lock_guard<mutex> lock(_mutex);
+    for (auto& j : _jobs) {
+        if (j.filename == filename) {
+            return j.block;
+        }
+    }
+    return nullptr;
+}
+
+void cache_writer::flush()
+{
+    unique_lock<mutex> lock(_mutex);
+    _written.wait(lock, [this]() { return _jobs.empty(); });
+}
+
+void cache_writer::run()
+{
+    trace::set_thread_name("cache writer");
+
+    unique_lock<mutex> lock(_mutex);
+    while (true) {
+        _queued.wait(lock, [this]() { return _done || !_jobs.empty(); });
+        if (_jobs.empty()) {
+            break;
+        }
+        job j = _jobs.front();
+        lock.unlock();
+
+        {
+            telemetry::scope scope(j.telemetry);
+            trace::span span("cache write", j.block_num);
+            auto start = chrono::steady_clock::now();
+            try {
+                cpio::file_writer writer;
+                writer.open(j.filename, "", true);
+                writer.write_all_records(*j.block);
+                writer.close();
+                if (j.telemetry != nullptr) {
+                    j.telemetry->cache_write_ns.record(telemetry::elapsed_ns(start));
+                }
+                if (j.index != nullptr) {
+                    uint32_t evicted = j.index->add(j.filename);
+                    if (j.telemetry != nullptr) {
+                        j.telemetry->cache_evictions += evicted;
+                    }
+                }
+            } catch (std::exception& e) {
+                // failure to write block to cache doesn't stop execution, only print an error
+                cerr << "ERROR writing block to cache: " << e.what() << endl;
+            }
+        }
+
+        lock.lock();
+        _jobs.pop_front();
+        _written.notify_all();
+    }
+}
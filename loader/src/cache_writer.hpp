@@ -0,0 +1,92 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "buffer_in.hpp"
+#include "cache_index.hpp"
+#include "telemetry.hpp"
+
+namespace nervana {
+    class cache_writer;
+}
+
+/* cache_writer
+ *
+ * A process wide thread which writes blocks out to the cpio cache, so that
+ * filling the cache doesn't hold up the read threads of the loaders.
+ *
+ * At most `depth` blocks wait to be written.  write() drops a block rather
+ * than wait for room, since a block which isn't cached now is just cached
+ * the next time it is loaded.  Blocks are written in the order they were
+ * queued.  A block written to a cache with a size budget is added to its
+ * `index`, which may evict others.
+ *
+ * A block is only visible in the cache once all of it is written, and until
+ * then pending() hands out the block itself, so a block which is read again
+ * before it has been written isn't loaded twice.  The buffers of a queued
+ * block must not be filled or reset again, only shared from.
+ *
+ * get() returns the instance shared by all cache loaders, creating it with
+ * `depth` if no loader currently holds it.
+ */
+class nervana::cache_writer {
+public:
+    explicit cache_writer(int depth);
+    ~cache_writer();
+
+    static std::shared_ptr<cache_writer> get(int depth);
+
+    // queues `block` to be written to `filename`, and returns false if it
+    // was dropped because the queue is full
+    bool write(const std::string& filename, uint32_t block_num,
+               const std::shared_ptr<nervana::buffer_in_array>& block,
+               const std::shared_ptr<nervana::cache_index>& index = nullptr);
+    // the block waiting to be written to `filename`, if any
+    std::shared_ptr<nervana::buffer_in_array> pending(const std::string& filename);
+    // blocks until every block queued so far has been written
+    void flush();
+
+private:
+    cache_writer() = delete;
+    cache_writer(const cache_writer&) = delete;
+
+    struct job {
+        std::string                                 filename;
+        uint32_t                                    block_num;
+        std::shared_ptr<nervana::buffer_in_array>   block;
+        std::shared_ptr<nervana::cache_index>       index;
+        // of the loader which queued the block
+        nervana::telemetry*                         telemetry;
+    };
+
+    void run();
+
+    const int                   _depth;
+    std::mutex                  _mutex;
+    std::condition_variable     _queued;
+    std::condition_variable     _written;
+    // the front job is the one being written
+    std::deque<job>             _jobs;
+    bool                        _done = false;
+    std::thread                 _thread;
+};
@@ -13,12 +13,24 @@
  limitations under the License.
 */
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
 #include "cpio.hpp"
 #include "util.hpp"
 
 using namespace std;
 using namespace nervana;
 
+namespace {
+    // of the files a file_writer builds before renaming them into place
+    const char* temp_suffix = ".tmp";
+}
+
 namespace nervana
 {
     template <typename T>
@@ -37,19 +49,64 @@ namespace nervana
     }
 
     template <typename T>
-    void write_single_value(ostream& ofs, T* data)
+    void parse_single_value(const char*& p, T* data)
+    {
+        memcpy(data, p, sizeof(T));
+        p += sizeof(T);
+    }
+
+    template <typename T>
+    void write_single_value(vector<char>& out, T* data)
     {
-        ofs.write(reinterpret_cast<char*>(data), sizeof(T));
+        const char* p = reinterpret_cast<const char*>(data);
+        out.insert(out.end(), p, p + sizeof(T));
     }
 
-    void writePadding(ostream& ofs, uint32_t length)
+    void writePadding(vector<char>& out, uint32_t length)
     {
         // Write a byte if length is odd.
         if (length % 2 != 0) {
             char byte = 0;
-            write_single_value(ofs, &byte);
+            write_single_value(out, &byte);
+        }
+    }
+
+    // parses the last trailer::tail_size() bytes of a file
+    void parse_tail(const char* data, cpio::trailer& t)
+    {
+        cpio::record_header header;
+        uint32_t size;
+        size_t length = header.parse(data, cpio::trailer::tail_size(), &size);
+        affirm(size == sizeof(cpio::trailer), "CPIO trailer not found");
+        t.parse(data + length);
+    }
+
+    void parse_index(const char* data, size_t count, vector<cpio::index_entry>& index)
+    {
+        index.resize(count);
+        for (auto& entry : index) {
+            parse_single_value(data, &entry.offset);
+            parse_single_value(data, &entry.size);
         }
     }
+
+    // the index entries of the elements of record `record_idx`
+    const cpio::index_entry* find_record(const vector<cpio::index_entry>& index, uint32_t elements,
+                                         int record_idx, const buffer_in_array& dest)
+    {
+        if (index.empty()) {
+            throw std::runtime_error("cpio file has no record index");
+        }
+        if (record_idx < 0 || (size_t)record_idx >= index.size() / elements) {
+            throw std::invalid_argument("record index out-of-range");
+        }
+        if (dest.size() != elements) {
+            stringstream ss;
+            ss << "records hold " << elements << " elements, but " << dest.size() << " buffers were given";
+            throw std::invalid_argument(ss.str());
+        }
+        return &index[record_idx * elements];
+    }
 }
 
 cpio::record_header::record_header() :
@@ -100,27 +157,56 @@ void cpio::record_header::read(istream& ifs, uint32_t* fileSize)
     readPadding(ifs, _namesize);
 }
 
-void cpio::record_header::write(ostream& ofs, uint32_t fileSize, const char* fileName)
+size_t cpio::record_header::parse(const char* data, size_t size, uint32_t* fileSize)
+{
+    const char* p = data;
+    affirm(size >= 13 * sizeof(uint16_t), "CPIO header truncated");
+    parse_single_value(p, &_magic);
+    affirm(_magic == 070707, "CPIO header magic incorrect");
+    parse_single_value(p, &_dev);
+    parse_single_value(p, &_ino);
+    parse_single_value(p, &_mode);
+    parse_single_value(p, &_uid);
+    parse_single_value(p, &_gid);
+    parse_single_value(p, &_nlink);
+    parse_single_value(p, &_rdev);
+    parse_single_value(p, &_mtime);
+    parse_single_value(p, &_namesize);
+    parse_single_value(p, &_filesize);
+    loadDoubleShort(fileSize, _filesize);
+    // Skip over filename.
+    size_t length = (p - data) + _namesize + _namesize % 2;
+    affirm(length <= size, "CPIO header truncated");
+    return length;
+}
+
+size_t cpio::record_header::length(const char* fileName)
+{
+    size_t namesize = strlen(fileName) + 1;
+    return 13 * sizeof(uint16_t) + namesize + namesize % 2;
+}
+
+void cpio::record_header::write(vector<char>& out, uint32_t fileSize, const char* fileName)
 {
     _namesize = strlen(fileName) + 1;
-    write_single_value(ofs, &_magic);
-    write_single_value(ofs, &_dev);
-    write_single_value(ofs, &_ino);
-    write_single_value(ofs, &_mode);
-    write_single_value(ofs, &_uid);
-    write_single_value(ofs, &_gid);
-    write_single_value(ofs, &_nlink);
-    write_single_value(ofs, &_rdev);
+    write_single_value(out, &_magic);
+    write_single_value(out, &_dev);
+    write_single_value(out, &_ino);
+    write_single_value(out, &_mode);
+    write_single_value(out, &_uid);
+    write_single_value(out, &_gid);
+    write_single_value(out, &_nlink);
+    write_single_value(out, &_rdev);
     time_t mtime;
     time(&mtime);
     saveDoubleShort(_mtime, mtime);
-    write_single_value(ofs, &_mtime);
-    write_single_value(ofs, &_namesize);
+    write_single_value(out, &_mtime);
+    write_single_value(out, &_namesize);
     saveDoubleShort(_filesize, fileSize);
-    write_single_value(ofs, &_filesize);
+    write_single_value(out, &_filesize);
     // Write filename.
-    ofs.write((char*) fileName, _namesize);
-    writePadding(ofs, _namesize);
+    out.insert(out.end(), fileName, fileName + _namesize);
+    writePadding(out, _namesize);
 }
 
 cpio::header::header()
@@ -144,31 +230,61 @@ void cpio::header::read(istream& ifs)
     read_single_value(ifs, &_unused);
 }
 
-void cpio::header::write(ostream& ofs)
+void cpio::header::parse(const char* data)
+{
+    const char* p = data;
+    parse_single_value(p, &_magic);
+    if (strncmp(_magic, MAGIC_STRING, 4) != 0) {
+        throw std::runtime_error("Unrecognized format\n");
+    }
+    parse_single_value(p, &_formatVersion);
+    parse_single_value(p, &_writerVersion);
+    parse_single_value(p, &_dataType);
+    parse_single_value(p, &_itemCount);
+    parse_single_value(p, &_unused);
+}
+
+void cpio::header::write(vector<char>& out)
 {
-    ofs.write((char*) MAGIC_STRING, strlen(MAGIC_STRING));
-    write_single_value(ofs, &_formatVersion);
-    write_single_value(ofs, &_writerVersion);
-    write_single_value(ofs, &_dataType);
-    write_single_value(ofs, &_itemCount);
-    write_single_value(ofs, &_unused);
+    out.insert(out.end(), MAGIC_STRING, MAGIC_STRING + strlen(MAGIC_STRING));
+    write_single_value(out, &_formatVersion);
+    write_single_value(out, &_writerVersion);
+    write_single_value(out, &_dataType);
+    write_single_value(out, &_itemCount);
+    write_single_value(out, &_unused);
 }
 
 cpio::trailer::trailer()
+: _indexOffset(0), _indexElements(0), _unused(0)
 {
-    memset(_unused, 0, sizeof(_unused));
 }
 
-void cpio::trailer::write(ostream& ofs)
+void cpio::trailer::write(vector<char>& out)
 {
-    write_single_value(ofs, &_unused);
+    write_single_value(out, &_indexOffset);
+    write_single_value(out, &_indexElements);
+    write_single_value(out, &_unused);
 }
 
 void cpio::trailer::read(istream& ifs)
 {
+    read_single_value(ifs, &_indexOffset);
+    read_single_value(ifs, &_indexElements);
     read_single_value(ifs, &_unused);
 }
 
+void cpio::trailer::parse(const char* data)
+{
+    parse_single_value(data, &_indexOffset);
+    parse_single_value(data, &_indexElements);
+    parse_single_value(data, &_unused);
+}
+
+size_t cpio::trailer::tail_size()
+{
+    return record_header::length("cpiotlr") + sizeof(trailer) + record_header::length(CPIO_FOOTER);
+}
+
 
 
 
@@ -218,6 +334,8 @@ cpio::file_reader::~file_reader() {
 bool cpio::file_reader::open(const string& fileName) {
     // returns true if file was opened successfully.
     bool rc = false;
+    _indexLoaded = false;
+    _index.clear();
     _ifs.open(fileName, istream::binary);
     if (_ifs) {
         _is = &_ifs;
@@ -234,49 +352,283 @@ void cpio::file_reader::close() {
     }
 }
 
+void cpio::file_reader::load_index() {
+    if (_indexLoaded) {
+        return;
+    }
+    auto pos = _ifs.tellg();
+    _ifs.seekg(0, _ifs.end);
+    int64_t size = _ifs.tellg();
+    affirm(size >= (int64_t)trailer::tail_size(), "CPIO trailer not found");
+
+    vector<char> data(trailer::tail_size());
+    _ifs.seekg(size - data.size());
+    _ifs.read(data.data(), data.size());
+    parse_tail(data.data(), _trailer);
+    if (_trailer._indexOffset != 0) {
+        size_t count = (size_t)itemCount() * _trailer._indexElements;
+        data.resize(count * sizeof(index_entry));
+        _ifs.seekg(_trailer._indexOffset);
+        _ifs.read(data.data(), data.size());
+        affirm(_ifs.good(), "CPIO index truncated");
+        parse_index(data.data(), count, _index);
+    }
+    _ifs.clear();
+    _ifs.seekg(pos);
+    _indexLoaded = true;
+}
+
+void cpio::file_reader::read_record(int record_idx, nervana::buffer_in_array& dest) {
+    load_index();
+    const index_entry* entries = find_record(_index, _trailer._indexElements, record_idx, dest);
+    auto pos = _ifs.tellg();
+    for (size_t i = 0; i < dest.size(); i++) {
+        _ifs.seekg(entries[i].offset);
+        dest[i]->read(_ifs, entries[i].size);
+    }
+    _ifs.seekg(pos);
+}
+
+cpio::mmap_reader::mmap_reader() {
+}
+
+cpio::mmap_reader::~mmap_reader() {
+    close();
+}
+
+bool cpio::mmap_reader::open(const string& fileName) {
+    // returns true if file was opened and mapped successfully.
+    close();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void*  addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    // every item is about to be read, so start reading the whole file in
+    madvise(addr, size, MADV_WILLNEED);
+    _mapping = shared_ptr<void>(addr, [size](void* p) { munmap(p, size); });
+    _begin   = static_cast<char*>(addr);
+    _pos     = _begin;
+    _end     = _begin + size;
+
+    uint32_t fileSize;
+    char* data = next_record(&fileSize);
+    if(fileSize != sizeof(_header)) {
+        stringstream ss;
+        ss << "unexpected header size.  expected " << sizeof(_header);
+        ss << " found " << fileSize;
+        throw std::runtime_error(ss.str());
+    }
+    _header.parse(data);
+    return true;
+}
+
+void cpio::mmap_reader::close() {
+    // buffers still holding items keep the file mapped
+    _mapping = nullptr;
+    _begin   = nullptr;
+    _pos     = nullptr;
+    _end     = nullptr;
+    _indexLoaded = false;
+    _index.clear();
+}
+
+void cpio::mmap_reader::load_index() {
+    if (_indexLoaded) {
+        return;
+    }
+    affirm(_begin != nullptr, "cpio file is not open");
+    size_t size = _end - _begin;
+    affirm(size >= trailer::tail_size(), "CPIO trailer not found");
+    parse_tail(_end - trailer::tail_size(), _trailer);
+    if (_trailer._indexOffset != 0) {
+        size_t count = (size_t)itemCount() * _trailer._indexElements;
+        affirm(_trailer._indexOffset + count * sizeof(index_entry) <= size, "CPIO index truncated");
+        parse_index(_begin + _trailer._indexOffset, count, _index);
+    }
+    _indexLoaded = true;
+}
+
+void cpio::mmap_reader::read_record(int record_idx, nervana::buffer_in_array& dest) {
+    load_index();
+    const index_entry* entries = find_record(_index, _trailer._indexElements, record_idx, dest);
+    for (size_t i = 0; i < dest.size(); i++) {
+        affirm(entries[i].offset + entries[i].size <= (size_t)(_end - _begin), "CPIO record truncated");
+        dest[i]->add_view(_mapping, _begin + entries[i].offset, entries[i].size);
+    }
+}
+
+char* cpio::mmap_reader::next_record(uint32_t* size) {
+    affirm(_pos != nullptr, "cpio file is not open");
+    _pos += _recordHeader.parse(_pos, _end - _pos, size);
+    affirm(*size <= (size_t)(_end - _pos), "CPIO record truncated");
+    char* data = _pos;
+    _pos += std::min<size_t>(*size + *size % 2, _end - _pos);
+    return data;
+}
+
+void cpio::mmap_reader::read(nervana::buffer_in& dest) {
+    uint32_t datumSize;
+    char* data = next_record(&datumSize);
+    dest.add_view(_mapping, data, datumSize);
+}
+
+int cpio::mmap_reader::itemCount() {
+    return _header._itemCount;
+}
+
 cpio::file_writer::~file_writer()
 {
-    close();
+    // a file which wasn't closed is incomplete, so it never gets its name
+    if (_fd >= 0) {
+        ::close(_fd);
+        unlink(_tempName.c_str());
+    }
 }
 
-void cpio::file_writer::open(const std::string& fileName, const std::string& dataType)
+void cpio::file_writer::open(const std::string& fileName, const std::string& dataType, bool index)
 {
     static_assert(sizeof(_header) == 64, "file header is not 64 bytes");
     _fileName = fileName;
-    _tempName = fileName + ".tmp";
-    _ofs.open(_tempName, ostream::binary);
-    _recordHeader.write(_ofs, 64, "cpiohdr");
-    _fileHeaderOffset = _ofs.tellp();
+    _writeIndex = index;
+    _elementCount = 0;
+    _index.clear();
+    _trailer = trailer();
+    // another writer of the same file must not truncate or write into ours
+    std::vector<char> name(fileName.begin(), fileName.end());
+    const std::string suffix = ".XXXXXX" + std::string(temp_suffix);
+    name.insert(name.end(), suffix.begin(), suffix.end());
+    name.push_back('\0');
+    _fd = mkstemps(name.data(), strlen(temp_suffix));
+    if (_fd < 0) {
+        throw std::runtime_error("Could not create " + fileName + suffix + ": " + strerror(errno));
+    }
+    _tempName = name.data();
+    // mkstemps creates the file readable by its owner only
+    fchmod(_fd, 0644);
+    _flushed = 0;
+    _staged.clear();
+    _recordHeader.write(_staged, 64, "cpiohdr");
+    _fileHeaderOffset = _staged.size();
     memset(_header._dataType, ' ', sizeof(_header._dataType));
     memcpy(_header._dataType, dataType.c_str(),
            std::min(8, (int) dataType.length()));
     // This will be incomplete until the write on close()
-    _header.write(_ofs);
+    _header.write(_staged);
 }
 
 void cpio::file_writer::close()
 {
-    if (_ofs.is_open() == true) {
+    if (_fd >= 0) {
         // Write the trailer.
         static_assert(sizeof(_trailer) == 16,
                       "file trailer is not 16 bytes");
-        _recordHeader.write(_ofs, 16, "cpiotlr");
-        _trailer.write(_ofs);
-        _recordHeader.write(_ofs, 0, CPIO_FOOTER);
+        // Records with differing numbers of elements can't be indexed.
+        if (_writeIndex && !_index.empty() &&
+            _index.size() == (size_t)_header._itemCount * _elementCount) {
+            _recordHeader.write(_staged, _index.size() * sizeof(index_entry), "cpioidx");
+            _trailer._indexOffset   = position();
+            _trailer._indexElements = _elementCount;
+            for (auto& entry : _index) {
+                write_single_value(_staged, &entry.offset);
+                write_single_value(_staged, &entry.size);
+            }
+        }
+        _recordHeader.write(_staged, 16, "cpiotlr");
+        _trailer.write(_staged);
+        _recordHeader.write(_staged, 0, CPIO_FOOTER);
+        flush();
         // Need to write back the max size values before cleaning up
-        _ofs.seekp(_fileHeaderOffset, _ofs.beg);
-        _header.write(_ofs);
-        _ofs.close();
+        _header.write(_staged);
+        if (pwrite(_fd, _staged.data(), _staged.size(), _fileHeaderOffset) != (ssize_t)_staged.size()) {
+            throw std::runtime_error("Could not write " + _tempName + ": " + strerror(errno));
+        }
+        _staged.clear();
+        // Only give the file its name once all of it is on disk, so that a crash
+        // can't leave a partly written file behind under that name.
+        if (fdatasync(_fd) != 0) {
+            throw std::runtime_error("Could not write " + _tempName + ": " + strerror(errno));
+        }
+        ::close(_fd);
+        _fd = -1;
         int result = rename(_tempName.c_str(), _fileName.c_str());
         if (result != 0) {
             stringstream ss;
             ss << "Could not create " << _fileName;
-            ss << ": " << strerror(result);
+            ss << ": " << strerror(errno);
+            unlink(_tempName.c_str());
             throw std::runtime_error(ss.str());
         }
     }
 }
 
+void cpio::file_writer::remove_stale_temp_files(const std::string& dir, int max_age_seconds)
+{
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return;
+    }
+    time_t now = time(nullptr);
+    while (struct dirent* ent = readdir(d)) {
+        std::string name = ent->d_name;
+        size_t      n    = strlen(temp_suffix);
+        if (name.size() <= n || name.compare(name.size() - n, n, temp_suffix) != 0) {
+            continue;
+        }
+        // a writer which is still going keeps touching its file
+        std::string path = dir + "/" + name;
+        struct stat stats;
+        if (stat(path.c_str(), &stats) == 0 && now - stats.st_mtime > max_age_seconds) {
+            unlink(path.c_str());
+        }
+    }
+    closedir(d);
+}
+
+void cpio::file_writer::flush(const char* data, size_t size)
+{
+    iovec  iov[2]  = {{_staged.data(), _staged.size()}, {const_cast<char*>(data), size}};
+    iovec* next    = iov;
+    int    count   = 2;
+    while (count > 0) {
+        if (next->iov_len == 0) {
+            next++;
+            count--;
+            continue;
+        }
+        ssize_t written = writev(_fd, next, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Could not write " + _tempName + ": " + strerror(errno));
+        }
+        _flushed += written;
+        // skip over whatever was written, which may end part way into a buffer
+        while (written > 0) {
+            size_t n = std::min((size_t)written, next->iov_len);
+            next->iov_base = static_cast<char*>(next->iov_base) + n;
+            next->iov_len -= n;
+            written       -= n;
+            if (next->iov_len == 0) {
+                next++;
+                count--;
+            }
+        }
+    }
+    _staged.clear();
+}
+
 void cpio::file_writer::write_all_records(nervana::buffer_in_array& buff)
 {
     int num_records = buff[0]->get_item_count();
@@ -291,7 +643,7 @@ void cpio::file_writer::write_record(nervana::buffer_in_array& buff, int record_
     uint32_t element_idx = 0;
     for (auto b : buff)
     {
-        const vector<char>& record_element = b->get_item(record_idx);
+        item_span record_element = b->get_item(record_idx);
         write_record_element(record_element.data(), record_element.size(), element_idx++);
     }
     increment_record_count();
@@ -301,7 +653,20 @@ void cpio::file_writer::write_record_element(const char* elem, uint32_t elem_siz
 {
     char fileName[16];
     snprintf(fileName, sizeof(fileName), "rec_%07d.%02d", _header._itemCount, element_idx);
-    _recordHeader.write(_ofs, elem_size, fileName);
-    _ofs.write(elem, elem_size);
-    writePadding(_ofs, elem_size);
+    _recordHeader.write(_staged, elem_size, fileName);
+    if (_writeIndex) {
+        _index.push_back({position(), elem_size});
+        _elementCount = std::max(_elementCount, element_idx + 1);
+    }
+    if (elem_size < _copyLimit) {
+        _staged.insert(_staged.end(), elem, elem + elem_size);
+        writePadding(_staged, elem_size);
+        if (_staged.size() >= _flushSize) {
+            flush();
+        }
+    } else {
+        // large items go straight from where they are, along with what's staged
+        flush(elem, elem_size);
+        writePadding(_staged, elem_size);
+    }
 }
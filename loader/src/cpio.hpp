@@ -37,10 +37,12 @@
 namespace nervana {
     namespace cpio {
         class record_header;
+        struct index_entry;
         class header;
         class trailer;
         class reader;
         class file_reader;
+        class mmap_reader;
         class file_writer;
     }
 }
@@ -59,10 +61,17 @@ Individual items are packed into a macrobatch file as follows:
     - datum 2
     - target 2
       ...
+    - index (optional)
     - trailer
 
 Each of these items comprises of a cpio header record followed by data.
 
+The index holds the offset and size of the data of every item, record by
+record, so that read_record() can go straight to any record.  The trailer
+gives where the index starts, or 0 if there is none.  The trailer is always
+the same distance from the end of the file, so the index is found without
+reading the records.
+
 */
 
 class nervana::cpio::record_header {
@@ -73,8 +82,14 @@ public:
     void saveDoubleShort(uint16_t* dst, uint32_t src);
 
     void read(std::istream& ifs, uint32_t* fileSize);
+    // parses the record header at the start of `data` and returns its length,
+    // including the file name and padding
+    size_t parse(const char* data, size_t size, uint32_t* fileSize);
+
+    void write(std::vector<char>& out, uint32_t fileSize, const char* fileName);
 
-    void write(std::ostream& ofs, uint32_t fileSize, const char* fileName);
+    // length of a record header for `fileName`, including padding
+    static size_t length(const char* fileName);
 
 public:
     uint16_t        _magic;
@@ -90,13 +105,20 @@ public:
     uint16_t        _filesize[2];
 };
 
+struct nervana::cpio::index_entry {
+    uint64_t        offset;
+    uint64_t        size;
+};
+
 class nervana::cpio::header {
 friend class reader;
+friend class mmap_reader;
 friend class file_writer;
 public:
     header();
     void read(std::istream& ifs);
-    void write(std::ostream& ofs);
+    void parse(const char* data);
+    void write(std::vector<char>& out);
 
 private:
 #pragma pack(1)
@@ -110,13 +132,22 @@ private:
 };
 
 class nervana::cpio::trailer {
+friend class file_reader;
+friend class mmap_reader;
+friend class file_writer;
 public:
     trailer() ;
-    void write(std::ostream& ofs);
+    void write(std::vector<char>& out);
     void read(std::istream& ifs);
+    void parse(const char* data);
+
+    // bytes from the start of the trailer's record header to the end of the file
+    static size_t tail_size();
 
 private:
-    uint32_t        _unused[4];
+    uint64_t        _indexOffset;       // of the index data, 0 if there is no index
+    uint32_t        _indexElements;     // elements per record in the index
+    uint32_t        _unused;
 };
 
 class nervana::cpio::reader {
@@ -151,15 +182,80 @@ public:
     bool open(const std::string& fileName);
     void close();
 
+    // reads element i of record `record_idx` into dest[i], using the index.
+    // read() carries on from where it was.
+    void read_record(int record_idx, nervana::buffer_in_array& dest);
+
+private:
+    void load_index();
+
+    std::ifstream                   _ifs;
+    bool                            _indexLoaded = false;
+    std::vector<index_entry>        _index;
+};
+
+/*
+ * mmap_reader reads a cpio file without copying it.  The file is mapped and
+ * read() adds each item to the buffer_in as a view of the mapped pages, so
+ * the headers are parsed in place and the bytes of an item are never
+ * copied.  The mapping outlives the reader for as long as any buffer_in
+ * still holds one of its items.
+ *
+ * The mapping is private and writable, so an item modified in place only
+ * changes that copy of its pages and never the file.
+ */
+
+class nervana::cpio::mmap_reader {
+public:
+    mmap_reader();
+    ~mmap_reader();
+
+    // returns false if the file can't be opened or mapped
+    bool open(const std::string& fileName);
+    void close();
+
+    void read(nervana::buffer_in& dest);
+    // reads element i of record `record_idx` into dest[i], using the index
+    void read_record(int record_idx, nervana::buffer_in_array& dest);
+
+    int itemCount();
+
 private:
-    std::ifstream   _ifs;
+    // the next record, checking that it lies within the file
+    char* next_record(uint32_t* size);
+    void load_index();
+
+    std::shared_ptr<void>       _mapping;
+    char*                       _begin = nullptr;
+    char*                       _pos = nullptr;
+    char*                       _end = nullptr;
+    header                      _header;
+    trailer                     _trailer;
+    record_header               _recordHeader;
+    bool                        _indexLoaded = false;
+    std::vector<index_entry>    _index;
 };
 
+/*
+ * file_writer builds a cpio file under a temporary name and only renames it
+ * into place, complete and synced to disk, in close().  A file_writer which
+ * is destroyed without being closed removes what it wrote.  The temporary
+ * name is unique to the writer, so several writers, in any process, can
+ * write the same file at once and it ends up as one of their files whole.
+ *
+ * remove_stale_temp_files() cleans up after writers which died before
+ * closing, going by the time since their file was last written.
+ *
+ * Headers and small items are staged in memory, and written along with
+ * large items, straight from where those are, with a single writev().
+ */
+
 class nervana::cpio::file_writer {
 public:
     ~file_writer();
 
-    void open(const std::string& fileName, const std::string& dataType = "");
+    // an index lets readers go straight to any record with read_record()
+    void open(const std::string& fileName, const std::string& dataType = "", bool index = false);
     void close();
 
     void write_all_records(nervana::buffer_in_array& buff);
@@ -167,12 +263,26 @@ public:
     void write_record_element(const char* elem, uint32_t elem_size, uint32_t element_idx);
     void increment_record_count() { _header._itemCount++;}
 
+    static void remove_stale_temp_files(const std::string& dir, int max_age_seconds = 3600);
+
 private:
-    std::ofstream   _ofs;
+    // writes the staged bytes, followed by `size` bytes at `data`
+    void flush(const char* data = nullptr, size_t size = 0);
+    uint64_t position() { return _flushed + _staged.size(); }
+
+    int             _fd = -1;
+    std::vector<char> _staged;
+    uint64_t        _flushed = 0;
     header          _header;
     trailer         _trailer;
     record_header   _recordHeader;
     int             _fileHeaderOffset;
     std::string     _fileName;
     std::string     _tempName;
+    bool            _writeIndex = false;
+    uint32_t        _elementCount = 0;
+    std::vector<index_entry> _index;
+
+    static constexpr size_t _copyLimit = 64 * 1024;
+    static constexpr size_t _flushSize = 1024 * 1024;
 };
@@ -0,0 +1,264 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#endif
+
+#include "cpu_affinity.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    // cpus are numbered below this, and a cpu_set_t can't hold any others
+#ifdef __linux__
+    const int cpu_limit = CPU_SETSIZE;
+#else
+    const int cpu_limit = 1024;
+#endif
+
+    int read_topology(int cpu, const string& name)
+    {
+        ifstream f("/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/" + name);
+        int value = 0;
+        f >> value;
+        return value;
+    }
+}
+
+cpu_affinity::cpu_affinity(const string& policy)
+{
+    if (policy.empty() || policy == "none") {
+        return;
+    }
+
+    vector<int> allowed = allowed_cpus();
+    if (policy == "compact" || policy == "scatter") {
+        struct cpu_info {
+            int cpu;
+            int node;
+            int package;
+            int core;
+            int sibling;    // which hyperthread of its core this is
+        };
+        vector<cpu_info> info;
+        for (int cpu : allowed) {
+            cpu_info ci;
+            ci.cpu     = cpu;
+            ci.node    = numa_node(cpu);
+            ci.package = read_topology(cpu, "physical_package_id");
+            ci.core    = read_topology(cpu, "core_id");
+            ci.sibling = 0;
+            for (auto& other : info) {
+                if (other.package == ci.package && other.core == ci.core) {
+                    ci.sibling++;
+                }
+            }
+            info.push_back(ci);
+        }
+
+        if (policy == "compact") {
+            sort(info.begin(), info.end(), [](const cpu_info& a, const cpu_info& b) {
+                return make_tuple(a.node, a.package, a.core, a.sibling) <
+                       make_tuple(b.node, b.package, b.core, b.sibling);
+            });
+            for (auto& ci : info) {
+                _cpus.push_back(ci.cpu);
+            }
+        } else {
+            // physical cores before hyperthreads, then deal the CPUs of
+            // each node out in turn
+            sort(info.begin(), info.end(), [](const cpu_info& a, const cpu_info& b) {
+                return make_tuple(a.sibling, a.package, a.core) <
+                       make_tuple(b.sibling, b.package, b.core);
+            });
+            vector<vector<int>> per_node;
+            vector<int>         nodes;
+            for (auto& ci : info) {
+                auto it = find(nodes.begin(), nodes.end(), ci.node);
+                if (it == nodes.end()) {
+                    nodes.push_back(ci.node);
+                    per_node.emplace_back();
+                    it = nodes.end() - 1;
+                }
+                per_node[it - nodes.begin()].push_back(ci.cpu);
+            }
+            for (size_t i = 0; _cpus.size() < info.size(); i++) {
+                for (auto& cpus : per_node) {
+                    if (i < cpus.size()) {
+                        _cpus.push_back(cpus[i]);
+                    }
+                }
+            }
+        }
+    } else {
+        _cpus = parse_cpu_list(policy);
+        if (_cpus.empty()) {
+            throw invalid_argument("thread_affinity must be compact, scatter or a list of cpus: " + policy);
+        }
+        // a thread pinned to a cpu outside the mask would just stay unpinned
+        vector<int> unavailable;
+        for (int cpu : _cpus) {
+            if (find(allowed.begin(), allowed.end(), cpu) == allowed.end()) {
+                unavailable.push_back(cpu);
+            }
+        }
+        if (!unavailable.empty()) {
+            throw invalid_argument("thread_affinity cpus " + join(unavailable, ",") +
+                                   " are not available to this process, which may use " +
+                                   join(allowed, ","));
+        }
+    }
+
+    _homeNode = numa_node(_cpus[0]);
+    for (int cpu : _cpus) {
+        if (numa_node(cpu) == _homeNode) {
+            _homeCpus.push_back(cpu);
+        }
+    }
+}
+
+int cpu_affinity::cpu_for(int index) const
+{
+    return enabled() ? _cpus[index % _cpus.size()] : -1;
+}
+
+void cpu_affinity::pin_thread(int index) const
+{
+    if (enabled()) {
+        pin_current_thread({cpu_for(index)});
+    }
+}
+
+void cpu_affinity::pin_to_home_node() const
+{
+    if (enabled()) {
+        pin_current_thread(_homeCpus);
+    }
+}
+
+void cpu_affinity::run_on_home_node(const function<void()>& func) const
+{
+    if (!enabled()) {
+        func();
+        return;
+    }
+    thread t([this, &func]() {
+        pin_to_home_node();
+        func();
+    });
+    t.join();
+}
+
+void cpu_affinity::pin_current_thread(const vector<int>& cpus)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        cerr << "unable to set thread affinity to cpus " << join(cpus, ",") << endl;
+    }
+#endif
+}
+
+vector<int> cpu_affinity::parse_cpu_list(const string& list)
+{
+    // the format of /sys/devices/system/node/node0/cpulist: "0-3,8,10-11"
+    vector<int> rc;
+    for (const string& range : split(list, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        int first;
+        int last;
+        try {
+            size_t dash = range.find('-');
+            first = stoi(range.substr(0, dash));
+            last  = dash == string::npos ? first : stoi(range.substr(dash + 1));
+        } catch (std::exception&) {
+            return vector<int>();
+        }
+        if (first < 0 || last < first) {
+            return vector<int>();
+        }
+        // checked before the range is expanded
+        if (last >= cpu_limit) {
+            throw invalid_argument("cpu " + to_string(last) + " is out of range, cpus are numbered below " +
+                                   to_string(cpu_limit));
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            rc.push_back(cpu);
+        }
+    }
+    return rc;
+}
+
+vector<int> cpu_affinity::allowed_cpus()
+{
+    vector<int> rc;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                rc.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (rc.empty()) {
+        for (unsigned int cpu = 0; cpu < std::max(1u, thread::hardware_concurrency()); cpu++) {
+            rc.push_back(cpu);
+        }
+    }
+    return rc;
+}
+
+int cpu_affinity::numa_node(int cpu)
+{
+    // sysfs links each cpu to its node as /sys/devices/system/cpu/cpuN/nodeM
+    int rc = 0;
+#ifdef __linux__
+    string path = "/sys/devices/system/cpu/cpu" + to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (dir != nullptr) {
+        while (struct dirent* entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                isdigit(name[4])) {
+                rc = atoi(name.c_str() + 4);
+                break;
+            }
+        }
+        closedir(dir);
+    }
+#endif
+    return rc;
+}
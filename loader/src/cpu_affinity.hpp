@@ -0,0 +1,69 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+namespace nervana {
+    class cpu_affinity;
+}
+
+/* cpu_affinity
+ *
+ * Decides which CPU each loader thread runs on.  The policy is one of
+ *
+ *   ""          don't pin threads at all (the default)
+ *   "compact"   fill one NUMA node before moving on to the next, keeping
+ *               hyperthreads of a core next to each other
+ *   "scatter"   spread threads across NUMA nodes and physical cores first
+ *   "0,2,8-11"  an explicit list of CPUs, used in the order given
+ *
+ * Only CPUs in the affinity mask the process started with are used by
+ * compact and scatter.  Thread i of a pool runs on cpus()[i % cpus().size()].
+ *
+ * The home node is the NUMA node of the first CPU.  Threads which aren't
+ * part of a pool (the read thread, the decode manager) are kept on the
+ * home node, and run_on_home_node() runs a function there so that memory
+ * it touches first is allocated on that node.
+ *
+ * Pinning is only implemented on Linux, elsewhere it is a no-op.
+ */
+class nervana::cpu_affinity {
+public:
+    explicit cpu_affinity(const std::string& policy = "");
+
+    bool                    enabled() const { return !_cpus.empty(); }
+    const std::vector<int>& cpus() const { return _cpus; }
+    int                     cpu_for(int index) const;
+    int                     home_node() const { return _homeNode; }
+    const std::vector<int>& home_cpus() const { return _homeCpus; }
+
+    void pin_thread(int index) const;
+    void pin_to_home_node() const;
+    void run_on_home_node(const std::function<void()>& func) const;
+
+    static void             pin_current_thread(const std::vector<int>& cpus);
+    static std::vector<int> parse_cpu_list(const std::string& list);
+    static std::vector<int> allowed_cpus();
+    static int              numa_node(int cpu);
+
+private:
+    std::vector<int>    _cpus;
+    std::vector<int>    _homeCpus;
+    int                 _homeNode = 0;
+};
@@ -0,0 +1,231 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "decode_executor.hpp"
+#include "util.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using namespace nervana;
+
+decode_executor::decode_executor(int count, const cpu_affinity& affinity)
+: _count(count),
+  _affinity(affinity)
+{
+    affirm(_count > 0, "decode_executor thread count must be > 0");
+    _idle_ns = unique_ptr<atomic<uint64_t>[]>(new atomic<uint64_t>[_count]);
+    for (int i = 0; i < _count; i++) {
+        _idle_ns[i] = 0;
+    }
+    for (int i = 0; i < _count; i++) {
+        _threads.push_back(new thread(&decode_executor::run, this, i));
+    }
+}
+
+decode_executor::~decode_executor()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _done = true;
+    }
+    _workAvailable.notify_all();
+    for (auto t : _threads) {
+        t->join();
+        delete t;
+    }
+}
+
+shared_ptr<decode_executor> decode_executor::get(int count, const cpu_affinity& affinity)
+{
+    // The instance lives as long as some loader holds it, so its threads
+    // go away with the last loader rather than at static destruction time.
+    static mutex                    instance_mutex;
+    static weak_ptr<decode_executor> instance;
+
+    lock_guard<mutex> lock(instance_mutex);
+    shared_ptr<decode_executor> rc = instance.lock();
+    if (rc == nullptr) {
+        rc = make_shared<decode_executor>(count > 0 ? count : available_cpus(), affinity);
+        instance = rc;
+    }
+    return rc;
+}
+
+int decode_executor::available_cpus(const string& cgroup_root)
+{
+    // cpuset, taskset and friends
+    int rc = cpu_affinity::allowed_cpus().size();
+
+    // CFS bandwidth limit.  Containers see their own cgroup at the root of
+    // the hierarchy, cgroup v2 first and then the two usual v1 mount points.
+    double quota  = -1;
+    double period = -1;
+    ifstream v2(cgroup_root + "/cpu.max");
+    if (v2) {
+        string q;
+        v2 >> q >> period;
+        if (q != "max") {
+            quota = stod(q);
+        }
+    } else {
+        for (const char* dir : {"/cpu", "/cpu,cpuacct"}) {
+            ifstream q(cgroup_root + dir + "/cpu.cfs_quota_us");
+            ifstream p(cgroup_root + dir + "/cpu.cfs_period_us");
+            if (q && p) {
+                q >> quota;
+                p >> period;
+                break;
+            }
+        }
+    }
+    if (quota > 0 && period > 0) {
+        rc = std::min(rc, std::max(1, (int)ceil(quota / period)));
+    }
+
+    return std::max(1, rc);
+}
+
+void decode_executor::add_client(client* c, int weight, int max_threads)
+{
+    affirm(weight > 0, "decode_executor client weight must be > 0");
+    affirm(max_threads > 0, "decode_executor client max_threads must be > 0");
+
+    unique_ptr<entry> e(new entry);
+    e->c           = c;
+    e->weight      = weight;
+    e->max_threads = max_threads;
+    {
+        lock_guard<mutex> lock(_mutex);
+        e->vtime = _vclock;
+        _clients.push_back(std::move(e));
+    }
+    _workAvailable.notify_all();
+}
+
+void decode_executor::set_max_threads(client* c, int max_threads)
+{
+    affirm(max_threads > 0, "decode_executor client max_threads must be > 0");
+    {
+        lock_guard<mutex> lock(_mutex);
+        entry* e = find(c);
+        if (e == nullptr) {
+            return;
+        }
+        e->max_threads = max_threads;
+    }
+    _workAvailable.notify_all();
+}
+
+decode_executor::entry* decode_executor::find(client* c)
+{
+    for (auto& e : _clients) {
+        if (e->c == c) {
+            return e.get();
+        }
+    }
+    return nullptr;
+}
+
+void decode_executor::remove_client(client* c)
+{
+    unique_lock<mutex> lock(_mutex);
+    entry* e = find(c);
+    if (e == nullptr) {
+        return;
+    }
+
+    e->removing = true;
+    while (e->users > 0) {
+        _released.wait(lock);
+    }
+
+    // the vector may have changed while we were waiting
+    _clients.erase(find_if(_clients.begin(), _clients.end(),
+                           [e](const unique_ptr<entry>& x) { return x.get() == e; }));
+}
+
+void decode_executor::notify()
+{
+    // Taking the lock orders this with a thread which has just found no
+    // work in pick() and is about to wait.
+    {
+        lock_guard<mutex> lock(_mutex);
+    }
+    _workAvailable.notify_all();
+}
+
+decode_executor::entry* decode_executor::pick()
+{
+    // the client furthest behind its fair share
+    entry* rc = nullptr;
+    for (auto& e : _clients) {
+        if (e->removing || e->users >= e->max_threads) {
+            continue;
+        }
+        if (rc != nullptr && e->vtime >= rc->vtime) {
+            continue;
+        }
+        if (e->c->has_work()) {
+            rc = e.get();
+        }
+    }
+    return rc;
+}
+
+void decode_executor::run(int id)
+{
+    _affinity.pin_thread(id);
+    trace::set_thread_name("decode " + to_string(id));
+
+    unique_lock<mutex> lock(_mutex);
+    while (_done == false) {
+        entry* e = pick();
+        if (e == nullptr) {
+            auto wait_start = chrono::steady_clock::now();
+            _workAvailable.wait(lock);
+            _idle_ns[id] += chrono::duration_cast<chrono::nanoseconds>(
+                                chrono::steady_clock::now() - wait_start).count();
+            continue;
+        }
+
+        // a client coming back from idle starts level with the others
+        e->vtime = std::max(e->vtime, _vclock);
+        _vclock  = e->vtime;
+        e->users++;
+        lock.unlock();
+
+        auto start = chrono::steady_clock::now();
+        try {
+            e->c->run_chunk(id);
+        } catch (std::exception& ex) {
+            cerr << "exception in decode_executor::run: " << ex.what() << endl;
+        }
+        double elapsed = chrono::duration_cast<chrono::nanoseconds>(
+                             chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        e->vtime += elapsed / e->weight;
+        e->users--;
+        if (e->removing && e->users == 0) {
+            _released.notify_all();
+        }
+    }
+}
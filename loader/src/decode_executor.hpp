@@ -0,0 +1,111 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "cpu_affinity.hpp"
+
+namespace nervana {
+    class decode_executor;
+}
+
+/* decode_executor
+ *
+ * A process wide pool of decode threads shared by every loader, so that
+ * running several loaders side by side doesn't oversubscribe the machine.
+ *
+ * Each loader registers a client with a weight.  Whenever a thread is free
+ * it runs one chunk of work for the client which has work available and has
+ * received the least decode time relative to its weight.  Busy clients split
+ * the threads in proportion to their weights, and a client with nothing to
+ * do leaves its share to the others.  A client which has been idle doesn't
+ * bank credit while idle, so it can't lock the other clients out when it
+ * comes back.  Clients can also be limited to a number of threads at once.
+ *
+ * get() returns the instance shared by all loaders, creating it with `count`
+ * threads if no loader currently holds it.  The default count is
+ * available_cpus(), which unlike hardware_concurrency() honours the cpuset
+ * and the CFS quota of the container we run in, as found under
+ * `cgroup_root`.  Executor thread i is
+ * pinned according to the affinity the executor was created with.
+ */
+class nervana::decode_executor {
+public:
+    class client {
+    public:
+        virtual ~client() {}
+
+        // Whether run_chunk() would find anything to do.  Called with the
+        // executor lock held, so it must not call back into the executor.
+        virtual bool has_work() = 0;
+
+        // Do one chunk of work on executor thread `thread_id`.
+        virtual void run_chunk(int thread_id) = 0;
+    };
+
+    decode_executor(int count, const cpu_affinity& affinity = cpu_affinity());
+    ~decode_executor();
+
+    static std::shared_ptr<decode_executor> get(int count = 0,
+                                                const cpu_affinity& affinity = cpu_affinity());
+    static int available_cpus(const std::string& cgroup_root = "/sys/fs/cgroup");
+
+    void add_client(client* c, int weight, int max_threads);
+    void set_max_threads(client* c, int max_threads);
+    // blocks until no executor thread is working for `c`
+    void remove_client(client* c);
+    // tell the executor that a client may have new work
+    void notify();
+
+    int      thread_count() { return _count; }
+    uint64_t idle_ns(int thread_id) { return _idle_ns[thread_id]; }
+
+private:
+    decode_executor() = delete;
+    decode_executor(const decode_executor&) = delete;
+
+    struct entry {
+        client* c;
+        int     weight;
+        int     max_threads;
+        int     users       = 0;
+        double  vtime       = 0;
+        bool    removing    = false;
+    };
+
+    void   run(int id);
+    entry* pick();
+    entry* find(client* c);
+
+    const int                               _count;
+    const cpu_affinity                      _affinity;
+    std::vector<std::thread*>               _threads;
+    std::unique_ptr<std::atomic<uint64_t>[]> _idle_ns;
+
+    std::mutex                              _mutex;
+    std::condition_variable                 _workAvailable;
+    std::condition_variable                 _released;
+    std::vector<std::unique_ptr<entry>>     _clients;
+    double                                  _vclock = 0;
+    bool                                    _done   = false;
+};
@@ -19,11 +19,14 @@
 #include <chrono>
 #include <utility>
 #include <algorithm>
+#include <cstring>
 
 #include "loader.hpp"
 #include "block_loader_cpio_cache.hpp"
 #include "block_iterator_sequential.hpp"
 #include "block_iterator_shuffled.hpp"
+#include "block_iterator_async.hpp"
+#include "block_iterator_shuffle_buffer.hpp"
 #include "batch_iterator.hpp"
 #include "manifest_nds.hpp"
 #include "block_loader_nds.hpp"
@@ -31,204 +34,383 @@
 using namespace std;
 using namespace nervana;
 
-decode_thread_pool::decode_thread_pool(int count,
+decode_thread_pool::decode_thread_pool(const shared_ptr<decode_executor>& executor,
                                        const shared_ptr<buffer_pool_in>& in,
                                        const shared_ptr<buffer_pool_out>& out,
-                                       const shared_ptr<python_backend>& pbe) :
-    thread_pool(count),
+                                       int batchSize,
+                                       int weight,
+                                       int max_threads) :
+    _executor(executor),
+    _count(executor->thread_count()),
+    _weight(weight),
+    _maxThreads(max_threads > 0 ? max_threads : _count),
     _in(in),
     _out(out),
-    _python_backend(pbe),
-    _batchSize(_python_backend->_batchSize)
+    _batchSize(batchSize)
 {
-    _itemsPerThread = (_batchSize - 1) / _count + 1;
-    affirm(_itemsPerThread * count >= _batchSize, "_itemsPerThread * count >= _batchSize");
-    affirm(_itemsPerThread * (count - 1) < _batchSize, "_itemsPerThread * (count - 1) < _batchSize");
+    // Chunks are small enough that every thread claims several per
+    // minibatch, so a thread stuck on one slow item doesn't hold up the rest.
+    _chunkSize = std::max(1, _batchSize / (_count * 8));
+    _threadCounters = unique_ptr<thread_counters[]>(new thread_counters[_count]);
 }
 
 void decode_thread_pool::add_provider(std::shared_ptr<nervana::provider_interface> prov)
 {
     _providers.push_back(prov);
-    _startSignaled.push_back(0);
+}
 
-    _startInds.push_back(0);
-    _endInds.push_back(0);
+vector<decode_thread_pool::thread_stats> decode_thread_pool::get_thread_stats()
+{
+    vector<thread_stats> rc;
+    for (int i = 0; i < _count; i++) {
+        thread_stats ts;
+        ts.busy_ns = _threadCounters[i].busy_ns;
+        ts.idle_ns = _executor->idle_ns(i);
+        ts.items   = _threadCounters[i].items;
+        rc.push_back(ts);
+    }
+    return rc;
 }
 
 decode_thread_pool::~decode_thread_pool()
 {
+    // wait for executor threads still decoding a chunk for us
+    _executor->remove_client(this);
+
     if (_manager != 0) {
         _manager->join();
         delete _manager;
     }
-    // Other thread objects are freed in the destructor of the parent class.
+    if (_finisher != 0) {
+        _finisher->join();
+        delete _finisher;
+    }
 }
 
 void decode_thread_pool::start()
 {
-    for (int i = 0; i < _count; i++) {
-        _threads.push_back(new thread(&decode_thread_pool::run, this, i));
-    }
+    affirm(_providers.size() == (size_t)_count, "decode_thread_pool needs a provider per executor thread");
     _manager = new thread(&decode_thread_pool::manage, this);
+    _finisher = new thread(&decode_thread_pool::finish, this);
+    _executor->add_client(this, _weight, _maxThreads);
 }
 
-void decode_thread_pool::stop()
+void decode_thread_pool::set_max_threads(int max_threads)
 {
-    thread_pool::stop();
-    while (stopped() == false) {
-        std::this_thread::yield();
-        _in->advance_write_pos();
-        _in->signal_not_empty();
-    }
+    _maxThreads = max_threads;
+    _executor->set_max_threads(this, max_threads);
+}
 
-    _stopManager = true;
-    while (_managerStopped == false) {
-        std::this_thread::yield();
-        _in->advance_write_pos();
-        _in->signal_not_empty();
-        _endSignaled++;
-        _ended.notify_one();
+void decode_thread_pool::stop()
+{
+    // The manager may also be blocked on the buffer pools, the owner of the
+    // pools must shut them down to wake it.
+    {
+        lock_guard<mutex> lock(_mutex);
+        _done = true;
     }
+    _ended.notify_all();
+    _stateChanged.notify_all();
 }
 
-void decode_thread_pool::run(int id)
+void decode_thread_pool::pause()
 {
-    // Initialize worker threads by computing memory offsets for the
-    // data this thread should work on
-    try {
-        affirm(id < _count, "id < _count");
-        _startInds[id] = id * _itemsPerThread;
-        int itemCount = _itemsPerThread;
-        if (id == _count - 1) {
-            itemCount = _batchSize - id * _itemsPerThread;
+    unique_lock<mutex> lock(_mutex);
+    _paused = true;
+    _stateChanged.notify_all();
+
+    // Items which nobody has claimed yet are simply dropped.  Items already
+    // claimed must be finished first since a thread is writing them.
+    for (auto& b : _inflight) {
+        b->doneItems += _batchSize - b->nextItem;
+        b->nextItem = _batchSize;
+    }
+    auto all_done = [this]() {
+        for (auto& b : _inflight) {
+            if (b->doneItems < _batchSize) {
+                return false;
+            }
         }
+        return true;
+    };
+    while (_done == false && (_managerParked == false || _finishing == true || all_done() == false)) {
+        _ended.wait(lock);
+    }
 
-        _endInds[id] = _startInds[id] + itemCount;
+    _inflight.clear();
+}
 
-        while (_done == false) {
-            work(id);
-        }
+void decode_thread_pool::resume()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _paused = false;
+    }
+    _stateChanged.notify_all();
+    _ended.notify_all();
+}
 
-        _stopped[id] = true;
-    } catch (std::exception& e) {
-        cerr << "fatal exception in decode_thread_pool::run: " << e.what() << endl;
-        // TODO: fail gracefully, not seg fault
+decode_thread_pool::batch* decode_thread_pool::next_batch()
+{
+    // oldest dispatched minibatch which still has unclaimed items
+    for (auto& b : _inflight) {
+        if (b->nextItem < _batchSize) {
+            return b.get();
+        }
     }
+    return nullptr;
 }
 
-void decode_thread_pool::work(int id)
+bool decode_thread_pool::has_work()
 {
-    // Thread function.
+    lock_guard<mutex> lock(_mutex);
+    return _done == false && next_batch() != nullptr;
+}
+
+void decode_thread_pool::run_chunk(int id)
+{
+    // Called on executor thread `id`.
+    batch* b = nullptr;
+    int start;
+    int end;
     {
-        unique_lock<mutex> lock(_mutex);
-        while (_startSignaled[id] == 0) {
-            _started.wait(lock);
-            if (_done == true) {
-                return;
-            }
+        lock_guard<mutex> lock(_mutex);
+        if (_done == true || (b = next_batch()) == nullptr) {
+            return;
         }
-        _startSignaled[id]--;
-        affirm(_startSignaled[id] == 0, "startSignaled not cleared");
+
+        // Claiming under the lock guarantees the batch can't be retired
+        // until this chunk is counted in doneItems.
+        start = b->nextItem;
+        end = std::min(start + _chunkSize, _batchSize);
+        b->nextItem = end;
     }
+    auto busy_start = chrono::steady_clock::now();
+    telemetry::scope scope(_telemetry);
 
-    // No locking required because threads write into non-overlapping regions.
+    // No locking required because each item is written by exactly one thread.
+    int items = 0;
     try {
-        affirm((*_inputBuf)[0]->get_item_count() != 0, "input buffer to decoded_thread_pool is empty");
-
-        for (int i = _startInds[id]; i < _endInds[id]; i++) {
-            _providers[id]->provide(i, *_inputBuf, _out->get_for_write());
+        for (int i = start; i < end; i++) {
+            trace::span span("provide", i);
+            auto item_start = chrono::steady_clock::now();
+            _providers[id]->provide(i, *b->in, *b->out);
+            if (_telemetry != nullptr) {
+                _telemetry->provide_ns.record(telemetry::elapsed_ns(item_start));
+            }
+            items++;
         }
     } catch (std::exception& e) {
         cout << "decode_thread_pool exception: " << e.what() << endl;
-        _out->write_exception(std::current_exception());
+        lock_guard<mutex> lock(_mutex);
+        if (!b->error) {
+            b->error = std::current_exception();
+        }
     }
 
-    {
-        lock_guard<mutex> lock(_mutex);
-        _endSignaled++;
-        affirm(_endSignaled <= _count, "endSignaled > count");
+    auto busy_end = chrono::steady_clock::now();
+    thread_counters& tc = _threadCounters[id];
+    tc.busy_ns += chrono::duration_cast<chrono::nanoseconds>(busy_end - busy_start).count();
+    tc.items   += items;
+
+    if (b->doneItems.fetch_add(end - start) + (end - start) == _batchSize) {
+        {
+            lock_guard<mutex> lock(_mutex);
+        }
+        _ended.notify_all();
     }
-    _ended.notify_one();
 }
 
-void decode_thread_pool::produce()
+void decode_thread_pool::manage()
 {
-    // lock on output buffers and copy to device
-    {
-        unique_lock<mutex> lock(_out->get_mutex());
-        while (_out->full() == true) {
-            _out->wait_for_non_full(lock);
-        }
-        {
-            lock_guard<mutex> lock(_mutex);
-            for (unsigned int i = 0; i < _startSignaled.size(); i++) {
-                _startSignaled[i] = 1;
+    _affinity.pin_to_home_node();
+    telemetry::scope scope(_telemetry);
+    trace::set_thread_name("decode manager");
+    try {
+        // Thread function.  Dispatch each input buffer, in order, as soon
+        // as there is an output buffer free for it.
+        uint64_t pos = _in->read_pos();
+        while (true) {
+            {
+                unique_lock<mutex> lock(_mutex);
+                if (_paused == true) {
+                    _managerParked = true;
+                    _ended.notify_all();
+                    while (_done == false && _paused == true) {
+                        _stateChanged.wait(lock);
+                    }
+                    _managerParked = false;
+
+                    // the pools may have been rewound while we were parked
+                    pos = _in->read_pos();
+                }
+                if (_done == true) {
+                    break;
+                }
             }
-        }
-        _started.notify_all();
-        {
-            unique_lock<mutex> lock(_mutex);
-            while (_endSignaled < _count) {
-                _ended.wait(lock);
+
+            if (_in->wait_for_readable(pos) == false || _out->wait_for_writable(pos) == false) {
+                // the pools were shut down, so we are about to be paused or stopped
+                unique_lock<mutex> lock(_mutex);
+                while (_done == false && _paused == false) {
+                    _stateChanged.wait(lock);
+                }
+                continue;
             }
-            _endSignaled = 0;
-        }
 
-        try {
-            // At this point, we have decoded data for the whole minibatch.
-            buffer_out_array& outBuf = _out->get_for_write();
+            if (_telemetry != nullptr) {
+                // read minibatches waiting to be decoded, counting this one
+                _telemetry->read_queue.record(_in->write_pos() - pos);
+            }
 
-            // Do any messy cross datum stuff you may need to do that requires minibatch consistency
-            _providers[0]->post_process(outBuf);
+            unique_ptr<batch> b(new batch);
+            b->in  = &_in->get(pos);
+            b->out = &_out->get(pos);
+            b->error = _in->get_exception(pos);
+            if (!b->error && (*b->in)[0]->get_item_count() == 0) {
+                b->error = make_exception_ptr(std::runtime_error("input buffer to decoded_thread_pool is empty"));
+            }
+            if (b->error) {
+                // nothing to decode, pass the error straight through to the consumer
+                b->nextItem  = _batchSize;
+                b->doneItems = _batchSize;
+            }
 
-            // Copy to device.
-            _python_backend->call_backend_transfer(outBuf, _bufferIndex);
-        } catch (std::exception& e) {
-            cout << "exception in provider post_process/call to backend transfer: " << e.what();
+            {
+                lock_guard<mutex> lock(_mutex);
+                if (_paused == true) {
+                    // pause() has already flushed _inflight
+                    continue;
+                }
+                _inflight.push_back(std::move(b));
+            }
+            _executor->notify();
+            _ended.notify_all();
+            pos++;
         }
-
-        _bufferIndex = (_bufferIndex == 0) ? 1 : 0;
-        _out->advance_write_pos();
+    } catch (std::exception& e) {
+        cerr << "exception in decode_thread_pool::manage: " << e.what() << endl;
+        // TODO: fail gracefully, not seg fault
     }
-    _out->signal_not_empty();
 }
 
-void decode_thread_pool::consume()
+void decode_thread_pool::finish()
 {
-    // lock on input buffers and call produce
-    {
-        unique_lock<mutex> lock(_in->get_mutex());
-        while (_in->empty() == true) {
-            _in->wait_for_not_empty(lock);
-            if (_stopManager == true) {
-                return;
+    _affinity.pin_to_home_node();
+    telemetry::scope scope(_telemetry);
+    trace::set_thread_name("decode finisher");
+    try {
+        // Thread function.  Retire minibatches in the order they were dispatched.
+        while (true) {
+            batch* b;
+            {
+                trace::span span("wait decoded");
+                unique_lock<mutex> lock(_mutex);
+                while (_done == false &&
+                       (_paused == true || _inflight.empty() ||
+                        _inflight.front()->doneItems < _batchSize)) {
+                    _ended.wait(lock);
+                }
+                if (_done == true) {
+                    break;
+                }
+                b = _inflight.front().get();
+                _finishing = true;
+            }
+
+            // Do any messy cross datum stuff you may need to do that requires minibatch
+            // consistency.  Copying to a device is left to the consumer, so nothing here
+            // waits on the consumer's runtime, e.g. for the python GIL.
+            try {
+                auto start = chrono::steady_clock::now();
+                {
+                    trace::span span("post process");
+                    _providers[0]->post_process(*b->out);
+                }
+                if (_telemetry != nullptr) {
+                    _telemetry->post_process_ns.record(telemetry::elapsed_ns(start));
+                }
+            } catch (std::exception& e) {
+                cout << "exception in provider post_process: " << e.what();
+            }
+
+            // Publish the output and release the input.  Both cursors only
+            // move here, so they always refer to the front of _inflight.
+            {
+                lock_guard<mutex> lock(_mutex);
+                if (b->error) {
+                    _out->write_exception(b->error);
+                }
+                _out->advance_write_pos();
+                _in->advance_read_pos();
+                _inflight.pop_front();
+                _finishing = false;
             }
+            // pause() may be waiting for us
+            _ended.notify_all();
         }
-        _inputBuf = &_in->get_for_read();
-        produce();
-        _in->advance_read_pos();
+    } catch (std::exception& e) {
+        cerr << "exception in decode_thread_pool::finish: " << e.what() << endl;
+        // TODO: fail gracefully, not seg fault
     }
-    _in->signal_not_full();
 }
 
-void decode_thread_pool::manage()
+
+decode_autotuner::decode_autotuner(int max_threads, int window) :
+    _maxThreads(max_threads),
+    _window(window),
+    _threads(max_threads)
 {
-    try {
-        // Thread function.
-        int result = 0;
-        if (result != 0) {
-            _stopManager = true;
-        }
-        while (_stopManager == false) {
-            consume();
+    affirm(_maxThreads > 0, "decode_autotuner max_threads must be > 0");
+    restart();
+}
+
+void decode_autotuner::restart()
+{
+    _calls       = 0;
+    _fullCalls   = 0;
+    _waitNs      = 0;
+    _shrunk      = false;
+    _windowStart = chrono::steady_clock::now();
+}
+
+bool decode_autotuner::record(uint64_t wait_ns, bool pool_full)
+{
+    _calls++;
+    _waitNs += wait_ns;
+    if (pool_full) {
+        _fullCalls++;
+    }
+    if (_calls < _window) {
+        return false;
+    }
+
+    auto   now     = chrono::steady_clock::now();
+    double elapsed = chrono::duration_cast<chrono::nanoseconds>(now - _windowStart).count();
+    bool   stalled = _waitNs > _stallFraction * elapsed;
+    bool   ahead   = !stalled && _fullCalls >= _fullFraction * _calls;
+
+    int previous = _threads;
+    if (stalled) {
+        if (_shrunk) {
+            // the last thread we took away was needed after all
+            _floor = std::min(_maxThreads, previous + 1);
         }
-        _managerStopped = true;
-    } catch (std::exception& e) {
-        cerr << "exception in decode_thread_pool::manage: " << e.what() << endl;
-        // TODO: fail gracefully, not seg fault
+        _threads = std::min(_maxThreads, previous + 1);
+        _shrunk  = false;
+    } else if (ahead && previous > _floor) {
+        _threads = previous - 1;
+        _shrunk  = true;
+    } else {
+        _shrunk  = false;
     }
-}
 
+    _calls       = 0;
+    _fullCalls   = 0;
+    _waitNs      = 0;
+    _windowStart = now;
+    return _threads != previous;
+}
 
 read_thread_pool::read_thread_pool(const shared_ptr<buffer_pool_in>& out,
                        const shared_ptr<batch_iterator>& b_it) :
@@ -237,47 +419,105 @@ read_thread_pool::read_thread_pool(const shared_ptr<buffer_pool_in>& out,
     _batch_iterator(b_it)
 {
     affirm(_count == 1, "thread pool count > 1");
+    _staging = unique_ptr<buffer_in_array>(new buffer_in_array(_out->get_buffer_count()));
+}
+
+void read_thread_pool::run(int id)
+{
+    _affinity.pin_to_home_node();
+    telemetry::scope scope(_telemetry);
+    trace::set_thread_name("read");
+    thread_pool::run(id);
+}
+
+void read_thread_pool::stop()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _done = true;
+    }
+    _stateChanged.notify_all();
+}
+
+void read_thread_pool::pause()
+{
+    unique_lock<mutex> lock(_mutex);
+    _paused = true;
+    _stateChanged.notify_all();
+    while (_done == false && _parked == false) {
+        _stateChanged.wait(lock);
+    }
+}
+
+void read_thread_pool::resume()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _paused = false;
+    }
+    _stateChanged.notify_all();
 }
 
 void read_thread_pool::work(int id)
 {
-    // Fill input buffers.
     {
-        unique_lock<mutex> lock(_out->get_mutex());
-        while (_out->full() == true) {
-            _out->wait_for_non_full(lock);
+        unique_lock<mutex> lock(_mutex);
+        if (_paused == true) {
+            _parked = true;
+            _stateChanged.notify_all();
+            while (_done == false && _paused == true) {
+                _stateChanged.wait(lock);
+            }
+            _parked = false;
         }
+        if (_done == true) {
+            return;
+        }
+    }
 
-        uint32_t tries = 0;
-        while(tries < 3) {
-            try {
-                tries += 1;
-                _batch_iterator->read(_out->get_for_write());
-                break;
-            } catch(std::exception& e) {
-                cout << "read_thread_pool exception:" << e.what() << endl;
-                _out->write_exception(std::current_exception());
-            }
+    // Fill the staging buffers.  This is where block I/O happens, so it
+    // must not be done while holding the lock on the input buffer pool.
+    // A failed attempt may have filled them partway, so each one starts
+    // from empty buffers.
+    bool   succeeded = false;
+    string last_error;
+    for (uint32_t tries = 0; tries < 3 && !succeeded; tries++) {
+        for (auto b : *_staging) {
+            b->reset();
         }
-        if(tries == 3) {
-            cout << "tried reading 3 times and failed.  Giving up";
-            throw std::runtime_error("tried 3 times to read from batch_iterator and failed each time.");
+        try {
+            trace::span span("read minibatch");
+            _batch_iterator->read(*_staging);
+            succeeded = true;
+        } catch(std::exception& e) {
+            cout << "read_thread_pool exception:" << e.what() << endl;
+            last_error = e.what();
         }
+    }
+    if (!succeeded) {
+        cout << "tried reading 3 times and failed.  Giving up";
+        throw std::runtime_error("tried 3 times to read from batch_iterator and failed each time: " + last_error);
+    }
 
-        _out->advance_write_pos();
+    // Publish the finished minibatch.
+    if (_out->wait_for_not_full() == false) {
+        // The pool was shut down, so we are about to be paused or stopped.
+        // Either way this minibatch is no longer wanted.
+        unique_lock<mutex> lock(_mutex);
+        while (_done == false && _paused == false) {
+            _stateChanged.wait(lock);
+        }
+        return;
     }
-    _out->signal_not_empty();
+
+    _out->get_for_write().swap(*_staging);
+    _out->advance_write_pos();
 }
 
 
-loader::loader(const char* cfg_string, PyObject *py_obj_backend)
+shared_ptr<block_loader> loader::make_block_loader(const loader_config& lcfg)
 {
-    _python_backend = make_shared<python_backend>(py_obj_backend);
-    _lcfg_json = nlohmann::json::parse(cfg_string);
-    loader_config lcfg(_lcfg_json);
-
-    _batchSize = lcfg.minibatch_size;
-    _single_thread_mode = lcfg.single_thread;
+    shared_ptr<block_loader> rc = nullptr;
     shared_ptr<nervana::manifest> base_manifest = nullptr;
 
     if(nervana::manifest_nds::is_likely_json(lcfg.manifest_filename)) {
@@ -286,10 +526,10 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
         auto manifest = make_shared<nervana::manifest_nds>(lcfg.manifest_filename);
 
         // TODO: add shard_count/shard_index to cfg
-        _block_loader = make_shared<block_loader_nds>(manifest->baseurl,
-                                                      manifest->token,
-                                                      manifest->collection_id,
-                                                      lcfg.macrobatch_size);
+        rc = make_shared<block_loader_nds>(manifest->baseurl,
+                                           manifest->token,
+                                           manifest->collection_id,
+                                           lcfg.macrobatch_size);
 
         base_manifest = manifest;
     } else {
@@ -302,20 +542,45 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
             throw std::runtime_error("manifest file is empty");
         }
 
-        _block_loader = make_shared<block_loader_file>(manifest,
-                                                       lcfg.subset_fraction,
-                                                       lcfg.macrobatch_size);
+        rc = make_shared<block_loader_file>(manifest,
+                                            lcfg.subset_fraction,
+                                            lcfg.macrobatch_size);
         base_manifest = manifest;
     }
 
     if(lcfg.cache_directory.length() > 0) {
-        string cache_id = base_manifest->cache_id() + to_string(_block_loader->objectCount());
-        _block_loader = make_shared<block_loader_cpio_cache>(lcfg.cache_directory,
-                                                             cache_id,
-                                                             base_manifest->version(),
-                                                             _block_loader);
+        string cache_id = base_manifest->cache_id() + to_string(rc->objectCount());
+        rc = make_shared<block_loader_cpio_cache>(lcfg.cache_directory,
+                                                  cache_id,
+                                                  base_manifest->version(),
+                                                  rc,
+                                                  lcfg.cache_write_depth,
+                                                  (uint64_t)lcfg.cache_size_mb << 20);
     }
 
+    return rc;
+}
+
+loader::loader(const string& cfg_string)
+{
+    _lcfg_json = nlohmann::json::parse(cfg_string);
+    loader_config lcfg(_lcfg_json);
+
+    _batchSize = lcfg.minibatch_size;
+    _single_thread_mode = lcfg.single_thread;
+    _read_buffer_depth = lcfg.read_buffer_depth;
+    _device_buffer_count = lcfg.device_buffer_count;
+    _decode_weight = lcfg.decode_weight;
+    _decode_thread_count = lcfg.decode_thread_count;
+    _decode_autotune = lcfg.decode_autotune;
+    _affinity = cpu_affinity(lcfg.thread_affinity);
+    _trace_file = lcfg.trace_file;
+    if (!_trace_file.empty()) {
+        _trace = unique_ptr<trace>(new trace(lcfg.trace_events));
+        _telemetry.tracer = _trace.get();
+    }
+    _block_loader = make_block_loader(lcfg);
+
     shared_ptr<block_iterator> block_iter;
     if (lcfg.shuffle_every_epoch) {
         block_iter = make_shared<block_iterator_shuffled>(_block_loader);
@@ -323,6 +588,22 @@ loader::loader(const char* cfg_string, PyObject *py_obj_backend)
         block_iter = make_shared<block_iterator_sequential>(_block_loader);
     }
 
+    if (lcfg.prefetch_blocks > 0) {
+        // read blocks ahead of the batch_iterator on a background thread.
+        // With the default of one block the next block loads while the
+        // current one is consumed and the two are swapped at the boundary.
+        block_iter = make_shared<block_iterator_async>(block_iter, lcfg.prefetch_blocks);
+    }
+
+    if (lcfg.shuffle_buffer_size > 0) {
+        // mix records across blocks, on top of the read-ahead so that block
+        // reads stay sequential
+        block_iter = make_shared<block_iterator_shuffle_buffer>(block_iter,
+                                                                _block_loader->blockCount(),
+                                                                lcfg.shuffle_buffer_size,
+                                                                lcfg.minibatch_size);
+    }
+
     _batch_iterator = make_shared<batch_iterator>(block_iter, lcfg.minibatch_size);
 }
 
@@ -330,43 +611,74 @@ int loader::start()
 {
     _first = true;
     try {
-        int ncores         = thread::hardware_concurrency();
-        int itemsPerThread = (_batchSize - 1) /  ncores + 1;
-        int nthreads       = (_batchSize - 1) / itemsPerThread + 1;
-        nthreads           = _single_thread_mode ? 1 : std::min(nthreads, _batchSize);
-
-        if (nthreads <= 0)
-        {
-            throw std::invalid_argument("Number of threads must be > 0");
+        // Decoding runs on the executor shared by all loaders in the process,
+        // which is sized by whichever loader creates it.  Any of its threads
+        // may decode for us, so each needs a provider.
+        int nthreads = _decode_thread_count;
+        if (nthreads == 0) {
+            nthreads = decode_executor::available_cpus();
+            if (_affinity.enabled()) {
+                nthreads = std::min(nthreads, (int)_affinity.cpus().size());
+            }
+        }
+        auto executor = decode_executor::get(nthreads, _affinity);
+        int  max_threads = _single_thread_mode ? 1 : std::min({nthreads,
+                                                               executor->thread_count(),
+                                                               _batchSize});
+        if (_decode_autotune && !_single_thread_mode) {
+            _autotuner = unique_ptr<decode_autotuner>(new decode_autotuner(max_threads));
         }
 
         vector<shared_ptr<nervana::provider_interface>> providers;
-        for (int i=0; i<nthreads; i++) {
+        for (int i=0; i<executor->thread_count(); i++) {
             providers.push_back(nervana::provider_factory::create(_lcfg_json));
         }
 
         // variable size buffers for reading encoded data (start off zero and grow as needed)
-        _read_buffers = make_shared<buffer_pool_in>(providers[0]->num_inputs);
+        _read_buffers = make_shared<buffer_pool_in>(providers[0]->num_inputs, _read_buffer_depth);
         _read_thread_pool = unique_ptr<read_thread_pool>(
                         new read_thread_pool(_read_buffers, _batch_iterator));
+        _read_thread_pool->set_affinity(_affinity);
+        _read_thread_pool->set_telemetry(&_telemetry);
 
         // fixed size buffers for writing out decoded data
-        const vector<nervana::shape_type>& oshapes = providers[0]->get_oshapes();
+        _oshapes = providers[0]->get_oshapes();
         vector<size_t> write_sizes;
-        for (auto& o: oshapes)
+        for (auto& o: _oshapes)
         {
             write_sizes.push_back(o.get_byte_size());
         }
 
-        // Bind the python backend here
-        _python_backend->setup_buffers(oshapes, _batchSize);
-        // These are fixed size output buffers (need batchSize for stride)
+        // Bind the consumer, e.g. the python backend, here
+        setup(_oshapes);
+        // These are fixed size output buffers (need batchSize for stride), one for each
+        // device buffer the consumer rotates through
         _decode_buffers = make_shared<buffer_pool_out>(write_sizes,
                                                        (size_t)_batchSize,
-                                                       _python_backend->use_pinned_memory());
+                                                       use_pinned_memory(),
+                                                       _device_buffer_count);
+        _telemetry.read_queue_depth   = _read_buffers->size();
+        _telemetry.decode_queue_depth = _decode_buffers->size();
+
+        // Pages are placed on the node of the thread which touches them
+        // first, so touch the output buffers from the home node where the
+        // loader's own threads run.
+        if (_affinity.enabled()) {
+            _affinity.run_on_home_node([this]() {
+                for (int i = 0; i < _decode_buffers->size(); i++) {
+                    buffer_out_array& bufs = _decode_buffers->get(i);
+                    for (size_t j = 0; j < bufs.size(); j++) {
+                        memset(bufs[j]->data(), 0, bufs[j]->size());
+                    }
+                }
+            });
+        }
 
         _decode_thread_pool = unique_ptr<decode_thread_pool>(
-                new decode_thread_pool(nthreads, _read_buffers, _decode_buffers, _python_backend));
+                new decode_thread_pool(executor, _read_buffers, _decode_buffers, _batchSize,
+                                       _decode_weight, max_threads));
+        _decode_thread_pool->set_affinity(_affinity);
+        _decode_thread_pool->set_telemetry(&_telemetry);
 
         for (auto& p: providers)
         {
@@ -384,64 +696,121 @@ int loader::start()
 
 void loader::stop()
 {
+    // Shutting the pools down wakes every thread blocked on them, so there
+    // is no need to drain them first.
+    _read_buffers->shutdown();
+    _decode_buffers->shutdown();
     _read_thread_pool->stop();
-    while (_read_thread_pool->stopped() == false)
-    {
-        std::this_thread::yield();
-        drain();
-    }
-    while ((_decode_buffers->empty() == false) ||
-           (_read_buffers->empty() == false))
-    {
-        drain();
-    }
     _decode_thread_pool->stop();
+    _read_thread_pool->join();
 
     _read_thread_pool   = nullptr;
-    _decode_buffers     = nullptr;
     _decode_thread_pool = nullptr;
-    _python_backend->clear_buffers();
+    _decode_buffers     = nullptr;
+    _held               = false;
+
+    if (_trace != nullptr) {
+        dump_trace(_trace_file);
+    }
 }
 
 int loader::reset()
 {
-    stop();
+    // Park the read and decode threads, throw away everything in flight and
+    // rewind.  The shutdown wakes up any thread blocked on a pool.
+    _read_buffers->shutdown();
+    _decode_buffers->shutdown();
+    _read_thread_pool->pause();
+    _decode_thread_pool->pause();
+
     _batch_iterator->reset();
-    return start();
+    _read_buffers->reset();
+    _decode_buffers->reset();
+    _first = true;
+    _held  = false;
+    if (_autotuner != nullptr) {
+        _autotuner->restart();
+    }
+
+    _decode_thread_pool->resume();
+    _read_thread_pool->resume();
+    return 0;
 }
 
-PyObject* loader::next(int bufIdx)
+const minibatch& loader::next()
 {
-    unique_lock<mutex> lock(_decode_buffers->get_mutex());
-    if (_first == true) {
-        _first = false;
-    } else {
-        // Unlock the buffer used for the previous minibatch.
-        _decode_buffers->advance_read_pos();
-        _decode_buffers->signal_not_full();
+    affirm(_held == false, "release() the previous minibatch before calling next() again");
+
+    // so that the wait for a minibatch shows up in a trace
+    telemetry::scope scope(&_telemetry);
+    trace::span span("next", _telemetry.minibatches);
+
+    bool first     = _first;
+    bool pool_full = _pool_full;
+    _first = false;
+
+    auto wait_start = chrono::steady_clock::now();
+    if (_decode_buffers->wait_for_not_empty() == false) {
+        throw std::runtime_error("loader has been stopped");
+    }
+    uint64_t wait_ns = chrono::duration_cast<chrono::nanoseconds>(
+                           chrono::steady_clock::now() - wait_start).count();
+
+    // decoded minibatches waiting for us, counting this one
+    _telemetry.decode_queue.record(_decode_buffers->used());
+    _telemetry.next_wait_ns.record(wait_ns);
+    _telemetry.minibatches++;
+
+    // the first minibatch waits for the pipeline to fill, which says
+    // nothing about how many threads we need
+    if (_autotuner != nullptr && first == false) {
+        if (_autotuner->record(wait_ns, pool_full)) {
+            _decode_thread_pool->set_max_threads(_autotuner->threads());
+        }
     }
 
-    while (_decode_buffers->empty()) {
-        _decode_buffers->wait_for_not_empty(lock);
+    try {
+        _decode_buffers->reraise_exception();
+    } catch (std::exception&) {
+        // nothing to hand out, so the buffer goes straight back
+        _decode_buffers->advance_read_pos();
+        throw;
     }
 
-    _decode_buffers->reraise_exception();
-    return _python_backend->get_host_tuple(bufIdx);
+    _minibatch._buffers   = &_decode_buffers->get_for_read();
+    _minibatch._shapes    = &_oshapes;
+    _minibatch._batchSize = _batchSize;
+    _held = true;
+    return _minibatch;
 }
 
-PyObject* loader::shapes()
+void loader::release()
 {
-    return _python_backend->get_shapes();
+    affirm(_held == true, "no minibatch to release");
+    _held = false;
+
+    // Decoding is ahead of us if it has filled every buffer.
+    _pool_full = _decode_buffers->full();
+    _decode_buffers->advance_read_pos();
 }
 
-void loader::drain()
+vector<decode_thread_pool::thread_stats> loader::decode_thread_stats()
 {
-    {
-        unique_lock<mutex> lock(_decode_buffers->get_mutex());
-        if (_decode_buffers->empty() == true) {
-            return;
-        }
-        _decode_buffers->advance_read_pos();
+    if (_decode_thread_pool == nullptr) {
+        return vector<decode_thread_pool::thread_stats>();
+    }
+    return _decode_thread_pool->get_thread_stats();
+}
+
+string loader::stats()
+{
+    return _telemetry.snapshot().dump();
+}
+
+void loader::dump_trace(const string& filename)
+{
+    if (_trace == nullptr) {
+        throw std::runtime_error("tracing is off, set trace_file in the loader config to turn it on");
     }
-    _decode_buffers->signal_not_full();
+    _trace->dump(filename.empty() ? _trace_file : filename);
 }
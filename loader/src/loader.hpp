@@ -21,9 +21,14 @@
 #include <chrono>
 #include <utility>
 #include <algorithm>
+#include <atomic>
+#include <deque>
 
-#include "python_backend.hpp"
 #include "thread_pool.hpp"
+#include "decode_executor.hpp"
+#include "cpu_affinity.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 #include "block_loader.hpp"
 #include "block_iterator.hpp"
 #include "batch_iterator.hpp"
@@ -35,62 +40,165 @@
 
 namespace nervana {
     class decode_thread_pool;
+    class decode_autotuner;
     class loader_config;
     class read_thread_pool;
+    class minibatch;
     class loader;
 }
 
 /* decode_thread_pool
  *
  * decode_thread_pool takes data from the BufferPool `in`, transforms it
- * using `count` threads with a Media::transform built from
+ * on the threads of a decode_executor with a Media::transform built from
  * `mediaParams`.  Each minibatch is transposed by a manager thread and
- * then copied to the `device`.
+ * then published to `out`.
+ *
+ * The executor is shared with every other loader in the process.  `weight`
+ * sets this loader's share of the executor threads while other loaders are
+ * busy too, and at most `max_threads` of them work for this loader at once.
+ * A provider is needed for each executor thread.
+ *
+ * Decoding is pipelined.  The manager thread dispatches every input buffer
+ * for which there is a free output buffer, so several minibatches can be in
+ * flight at once.  Threads claim small chunks of items from the oldest
+ * dispatched minibatch which still has unclaimed items, and move straight on
+ * to the next minibatch when it runs out.  A finisher thread runs
+ * post_process and publishes completed minibatches strictly
+ * in dispatch order, so minibatch order is deterministic.
+ *
+ * Time each executor thread spends decoding for this loader (busy) and
+ * waiting for work from any loader (idle) is available from
+ * get_thread_stats().
+ *
+ * pause() drops every minibatch in flight and parks the manager, so that
+ * the buffer pools can be rewound between epochs without stopping any
+ * threads.  resume() picks up again from the current pool positions.  The
+ * pools must be shut down before calling pause() or stop(), otherwise the
+ * manager may stay blocked on them.
+ *
+ * The manager and finisher threads run on the home node of the affinity
+ * given to set_affinity().
+ *
+ * Decoding and post_process times are recorded in the
+ * telemetry given to set_telemetry().
  *
  */
-class nervana::decode_thread_pool : public nervana::thread_pool {
+class nervana::decode_thread_pool : public nervana::decode_executor::client {
 public:
-    decode_thread_pool(int count,
+    decode_thread_pool(const std::shared_ptr<nervana::decode_executor>& executor,
                        const std::shared_ptr<nervana::buffer_pool_in>& in,
                        const std::shared_ptr<nervana::buffer_pool_out>& out,
-                       const std::shared_ptr<python_backend>& pbe);
+                       int batchSize,
+                       int weight = 1,
+                       int max_threads = 0);
 
     virtual ~decode_thread_pool();
-    virtual void start() override;
-    virtual void stop() override;
+    void start();
+    void stop();
+    void pause();
+    void resume();
     void add_provider(std::shared_ptr<nervana::provider_interface> prov);
+    void set_max_threads(int max_threads);
+    int  get_max_threads() { return _maxThreads; }
+    void set_affinity(const nervana::cpu_affinity& affinity) { _affinity = affinity; }
+    void set_telemetry(nervana::telemetry* t) { _telemetry = t; }
+
+    struct thread_stats {
+        uint64_t busy_ns;
+        uint64_t idle_ns;
+        uint64_t items;
+    };
+    std::vector<thread_stats> get_thread_stats();
 
 protected:
-    virtual void run(int id) override;
-    virtual void work(int id) override;
-    void produce();
-    void consume();
+    virtual bool has_work() override;
+    virtual void run_chunk(int id) override;
     void manage();
+    void finish();
 
 private:
     decode_thread_pool();
     decode_thread_pool(const decode_thread_pool&);
 
-    int                         _itemsPerThread;
+    // a minibatch which has been dispatched but not yet handed to the backend
+    struct batch {
+        nervana::buffer_in_array*   in;
+        nervana::buffer_out_array*  out;
+        int                         nextItem = 0;   // guarded by _mutex
+        std::atomic<int>            doneItems{0};
+        std::exception_ptr          error;          // guarded by _mutex
+    };
+
+    struct thread_counters {
+        std::atomic<uint64_t>   busy_ns{0};
+        std::atomic<uint64_t>   items{0};
+    };
+
+    batch* next_batch();
+
+    std::shared_ptr<nervana::decode_executor> _executor;
+    int                         _count;
+    int                         _weight;
+    std::atomic<int>            _maxThreads;
+    nervana::cpu_affinity       _affinity;
+    nervana::telemetry*         _telemetry      = nullptr;
+    int                         _chunkSize;
+    std::unique_ptr<thread_counters[]> _threadCounters;
     std::shared_ptr<nervana::buffer_pool_in> _in;
     std::shared_ptr<nervana::buffer_pool_out> _out;
-    std::shared_ptr<python_backend> _python_backend;
     std::mutex                  _mutex;
-    std::condition_variable     _started;
     std::condition_variable     _ended;
+    std::condition_variable     _stateChanged;
     int                         _batchSize;
-    int                         _endSignaled    = 0;
     std::thread*                _manager        = 0;
-    bool                        _stopManager    = false;
-    bool                        _managerStopped = false;
-    nervana::buffer_in_array*   _inputBuf       = 0;
-    int                         _bufferIndex    = 0;
+    std::thread*                _finisher       = 0;
+    bool                        _done           = false;    // guarded by _mutex
+    bool                        _paused         = false;    // guarded by _mutex
+    bool                        _managerParked  = false;    // guarded by _mutex
+    bool                        _finishing      = false;    // guarded by _mutex
+
+    std::deque<std::unique_ptr<batch>> _inflight;
 
     std::vector<std::shared_ptr<nervana::provider_interface>> _providers;
+};
+
+/* decode_autotuner
+ *
+ * Looks for the smallest number of decode threads which keeps the consumer
+ * fed.  The loader reports every call to next(): how long the consumer had
+ * to wait for a minibatch, and whether the output pool was full, meaning
+ * decoding was running ahead of the consumer.
+ *
+ * Every `window` calls the thread count grows by one if the consumer spent
+ * a noticeable part of the window waiting, and shrinks by one if it never
+ * waited and the pool was nearly always full.  When taking a thread away
+ * makes the consumer wait, the count is never reduced that far again.
+ */
+class nervana::decode_autotuner {
+public:
+    decode_autotuner(int max_threads, int window = 16);
 
-    std::vector<int>            _startSignaled;
-    std::vector<int>            _startInds;
-    std::vector<int>            _endInds;
+    // returns true if threads() changed
+    bool record(uint64_t wait_ns, bool pool_full);
+    // forget the current window, e.g. after the pipeline has been flushed
+    void restart();
+    int  threads() const { return _threads; }
+
+private:
+    int                         _maxThreads;
+    int                         _window;
+    int                         _threads;
+    int                         _floor      = 1;
+    bool                        _shrunk     = false;
+
+    int                         _calls      = 0;
+    int                         _fullCalls  = 0;
+    uint64_t                    _waitNs     = 0;
+    std::chrono::steady_clock::time_point _windowStart;
+
+    static constexpr double     _stallFraction  = 0.02;
+    static constexpr double     _fullFraction   = 0.9;
 };
 
 class nervana::loader_config : public nervana::interface::config {
@@ -101,12 +209,24 @@ public:
 
     std::string type;
     std::string cache_directory     = "";
+    int         cache_write_depth   = 4;
+    int         cache_size_mb       = 0;
     int         macrobatch_size     = 0;
     float       subset_fraction     = 1.0;
     bool        shuffle_every_epoch = false;
     bool        shuffle_manifest    = false;
     bool        single_thread       = false;
     int         random_seed         = 0;
+    int         prefetch_blocks     = 1;
+    int         shuffle_buffer_size = 0;
+    int         read_buffer_depth   = 2;
+    int         device_buffer_count = 2;
+    int         decode_weight       = 1;
+    int         decode_thread_count = 0;
+    bool        decode_autotune     = false;
+    std::string thread_affinity     = "";
+    std::string trace_file          = "";
+    int         trace_events        = 16384;
 
     loader_config(nlohmann::json js)
     {
@@ -134,22 +254,75 @@ private:
         ADD_SCALAR(manifest_root, mode::OPTIONAL),
         ADD_SCALAR(minibatch_size, mode::REQUIRED),
         ADD_SCALAR(cache_directory, mode::OPTIONAL),
+        ADD_SCALAR(cache_write_depth, mode::OPTIONAL),
+        ADD_SCALAR(cache_size_mb, mode::OPTIONAL),
         ADD_SCALAR(macrobatch_size, mode::OPTIONAL),
         ADD_SCALAR(subset_fraction, mode::OPTIONAL),
         ADD_SCALAR(shuffle_every_epoch, mode::OPTIONAL),
         ADD_SCALAR(shuffle_manifest, mode::OPTIONAL),
         ADD_SCALAR(single_thread, mode::OPTIONAL),
         ADD_SCALAR(random_seed, mode::OPTIONAL),
+        ADD_SCALAR(prefetch_blocks, mode::OPTIONAL),
+        ADD_SCALAR(shuffle_buffer_size, mode::OPTIONAL),
+        ADD_SCALAR(read_buffer_depth, mode::OPTIONAL),
+        ADD_SCALAR(device_buffer_count, mode::OPTIONAL),
+        ADD_SCALAR(decode_weight, mode::OPTIONAL),
+        ADD_SCALAR(decode_thread_count, mode::OPTIONAL),
+        ADD_SCALAR(decode_autotune, mode::OPTIONAL),
+        ADD_SCALAR(thread_affinity, mode::OPTIONAL),
+        ADD_SCALAR(trace_file, mode::OPTIONAL),
+        ADD_SCALAR(trace_events, mode::OPTIONAL),
     };
 
     loader_config() {}
-    bool validate() { return true; }
+    bool validate()
+    {
+        if (cache_write_depth < 0) {
+            throw std::invalid_argument("cache_write_depth must be >= 0");
+        }
+        if (cache_size_mb < 0) {
+            throw std::invalid_argument("cache_size_mb must be >= 0");
+        }
+        if (prefetch_blocks < 0) {
+            throw std::invalid_argument("prefetch_blocks must be >= 0");
+        }
+        if (shuffle_buffer_size < 0) {
+            throw std::invalid_argument("shuffle_buffer_size must be >= 0");
+        }
+        if (read_buffer_depth < 1) {
+            throw std::invalid_argument("read_buffer_depth must be >= 1");
+        }
+        if (device_buffer_count < 1) {
+            throw std::invalid_argument("device_buffer_count must be >= 1");
+        }
+        if (decode_weight < 1) {
+            throw std::invalid_argument("decode_weight must be >= 1");
+        }
+        if (decode_thread_count < 0) {
+            throw std::invalid_argument("decode_thread_count must be >= 0");
+        }
+        if (trace_events < 1) {
+            throw std::invalid_argument("trace_events must be >= 1");
+        }
+        return true;
+    }
 };
 
 /*
  * The read_thread_pool wraps BatchIterator in a thread an coordinates work
  * with other threads via locks on the output BufferPool `out`
  *
+ * Minibatches are read into a private staging buffer without holding the lock
+ * on `out`, and are only swapped into the pool once they are complete.
+ *
+ * pause() returns once the thread is parked between minibatches, so the
+ * batch_iterator can be reset from another thread.
+ *
+ * The thread runs on the home node of the affinity given to set_affinity(),
+ * so the buffer_in storage it allocates and fills is local to that node.
+ *
+ * Block I/O on the thread is recorded in the telemetry given to
+ * set_telemetry().
  */
 
 class nervana::read_thread_pool: public thread_pool {
@@ -157,7 +330,14 @@ public:
     read_thread_pool(const std::shared_ptr<nervana::buffer_pool_in>& out,
                      const std::shared_ptr<nervana::batch_iterator>& batch_iterator);
 
+    virtual void stop() override;
+    void pause();
+    void resume();
+    void set_affinity(const nervana::cpu_affinity& affinity) { _affinity = affinity; }
+    void set_telemetry(nervana::telemetry* t) { _telemetry = t; }
+
 protected:
+    virtual void run(int id) override;
     virtual void work(int id) override;
 
 private:
@@ -165,47 +345,126 @@ private:
     read_thread_pool(const read_thread_pool&);
     std::shared_ptr<nervana::buffer_pool_in> _out;
     std::shared_ptr<nervana::batch_iterator> _batch_iterator;
+    std::unique_ptr<nervana::buffer_in_array> _staging;
+
+    std::mutex                  _mutex;
+    std::condition_variable     _stateChanged;
+    bool                        _paused = false;
+    bool                        _parked = false;
+    nervana::cpu_affinity       _affinity;
+    nervana::telemetry*         _telemetry = nullptr;
 };
 
 
+/* minibatch
+ *
+ * A decoded minibatch returned by loader::next().  Output i is one buffer
+ * holding batch_size() items, each of shape(i), which gives the dimensions
+ * and element type of an item and its size in bytes.
+ */
+class nervana::minibatch {
+public:
+    size_t size() const { return _shapes->size(); }
+    int batch_size() const { return _batchSize; }
+    const nervana::shape_type& shape(size_t i) const { return (*_shapes)[i]; }
+    char* data(size_t i) const { return (*_buffers)[i]->data(); }
+    size_t byte_size(size_t i) const { return (*_buffers)[i]->size(); }
+    nervana::buffer_out_array& buffers() const { return *_buffers; }
+
+private:
+    friend class loader;
+    nervana::buffer_out_array*              _buffers    = nullptr;
+    const std::vector<nervana::shape_type>* _shapes     = nullptr;
+    int                                     _batchSize  = 0;
+};
+
 /* loader
  *
  * The loader instantiates and then coordinates the effort of loading ingested data, caching
  * blocks of it in contiguous disk (using cpio file format), transforming the data and finally
  * loading the data into device memory
+ *
+ * The loader is built from its JSON config alone and needs no Python.  next() waits for the
+ * next decoded minibatch, which stays valid until it is handed back with release().  Only
+ * one minibatch may be held at a time.  get_oshapes() gives the shape and element type of an
+ * item of each output once the loader has been started.
+ *
+ * reset() rewinds the data to the start of the epoch.  Threads, providers and buffers all
+ * survive a reset.  A minibatch held across a reset must not be released.
+ *
+ * stats() returns a JSON snapshot of the loader's telemetry: the time spent in each stage
+ * of the pipeline, cache hits and misses, how full the buffer pools are, how long next()
+ * waits, and which stage that makes the bottleneck.
+ *
+ * If trace_file is set, the loader also records a timeline of every thread's activity and
+ * writes it to trace_file in Chrome trace format when stopped.  dump_trace() writes the
+ * timeline so far at any time.
+ *
+ * Bindings to other runtimes hook in by overriding use_pinned_memory() and setup(), which
+ * start() calls with the output shapes before anything is decoded.  They hand minibatches
+ * on from next(), on the consumer's thread, so no loader thread ever waits on them.
+ * device_buffer_count() is how many device buffers such a consumer rotates through, and
+ * the loader keeps as many decoded minibatches.
 */
 
 class nervana::loader {
 public:
-    loader(const char*, PyObject *);
+    explicit loader(const std::string& config);
 
     virtual ~loader() {}
     int start();
     void stop();
     int reset();
-    PyObject* shapes();
-    PyObject* next(int bufIdx);
+    const nervana::minibatch& next();
+    void release();
+    const std::vector<nervana::shape_type>& get_oshapes() { return _oshapes; }
+    int batch_size() { return _batchSize; }
+    int device_buffer_count() { return _device_buffer_count; }
 
     int itemCount() { return _block_loader->objectCount(); }
+    std::vector<decode_thread_pool::thread_stats> decode_thread_stats();
+    std::string stats();
+    void dump_trace(const std::string& filename);
 
-private:
-    void drain();
+    // the blocks a loader with `lcfg` reads, through the cpio cache if
+    // lcfg has a cache_directory
+    static std::shared_ptr<nervana::block_loader> make_block_loader(const nervana::loader_config& lcfg);
+
+protected:
+    virtual bool use_pinned_memory() { return false; }
+    virtual void setup(const std::vector<nervana::shape_type>& oshapes) {}
+    nervana::telemetry& get_telemetry() { return _telemetry; }
 
 private:
     loader();
     loader(const loader&);
 
     bool                                        _first = true;
+    bool                                        _held = false;
+    bool                                        _pool_full = false;
     bool                                        _single_thread_mode = false;
+    int                                         _read_buffer_depth = 2;
+    int                                         _device_buffer_count = 2;
+    int                                         _decode_weight = 1;
+    int                                         _decode_thread_count = 0;
+    bool                                        _decode_autotune = false;
+    nervana::cpu_affinity                       _affinity;
+    std::string                                 _trace_file;
+
+    // declared before anything whose threads record into them
+    std::unique_ptr<nervana::trace>             _trace = nullptr;
+    nervana::telemetry                          _telemetry;
 
     std::shared_ptr<nervana::buffer_pool_in>    _read_buffers = nullptr;
     std::shared_ptr<nervana::buffer_pool_out>   _decode_buffers = nullptr;
     std::unique_ptr<nervana::read_thread_pool>  _read_thread_pool = nullptr;
     std::unique_ptr<decode_thread_pool>         _decode_thread_pool = nullptr;
+    std::unique_ptr<decode_autotuner>           _autotuner = nullptr;
     std::shared_ptr<nervana::block_loader>      _block_loader = nullptr;
     std::shared_ptr<nervana::batch_iterator>    _batch_iterator = nullptr;
 
     int                                         _batchSize;
     nlohmann::json                              _lcfg_json;
-    std::shared_ptr<python_backend>             _python_backend;
+    std::vector<nervana::shape_type>            _oshapes;
+    nervana::minibatch                          _minibatch;
 };
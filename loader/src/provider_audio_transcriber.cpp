@@ -14,6 +14,7 @@
 */
 
 #include "provider_audio_transcriber.hpp"
+#include "telemetry.hpp"
 
 using namespace nervana;
 using namespace std;
@@ -41,8 +42,8 @@ audio_transcriber::audio_transcriber(nlohmann::json js) :
 
 void audio_transcriber::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf)
 {
-    vector<char>& datum_in  = in_buf[0]->get_item(idx);
-    vector<char>& target_in = in_buf[1]->get_item(idx);
+    item_span datum_in  = in_buf[0]->get_item(idx);
+    item_span target_in = in_buf[1]->get_item(idx);
 
     char* datum_out  = out_buf[0]->get_item(idx);
     char* target_out = out_buf[1]->get_item(idx);
@@ -50,13 +51,20 @@ void audio_transcriber::provide(int idx, buffer_in_array& in_buf, buffer_out_arr
     char* valid_out  = out_buf[3]->get_item(idx);
 
     // Process audio data
+    telemetry::stopwatch timer;
     auto audio_dec = audio_extractor.extract(datum_in.data(), datum_in.size());
+    timer.lap(telemetry::extract);
     auto audio_params = audio_factory.make_params(audio_dec);
-    audio_loader.load({datum_out}, audio_transformer.transform(audio_params, audio_dec));
+    auto audio_transformed = audio_transformer.transform(audio_params, audio_dec);
+    timer.lap(telemetry::transform);
+    audio_loader.load({datum_out}, audio_transformed);
+    timer.lap(telemetry::load);
 
     // Process target data
     auto trans_dec = trans_extractor.extract(target_in.data(), target_in.size());
+    timer.lap(telemetry::extract);
     trans_loader.load({target_out}, trans_dec);
+    timer.lap(telemetry::load);
 
     // Save out the length
     uint32_t trans_length = trans_dec->get_length();
@@ -14,6 +14,7 @@
 */
 
 #include "provider_image_boundingbox.hpp"
+#include "telemetry.hpp"
 
 using namespace nervana;
 using namespace std;
@@ -35,8 +36,8 @@ image_boundingbox::image_boundingbox(nlohmann::json js) :
 }
 
 void image_boundingbox::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) {
-    std::vector<char>& datum_in  = in_buf[0]->get_item(idx);
-    std::vector<char>& target_in = in_buf[1]->get_item(idx);
+    item_span datum_in  = in_buf[0]->get_item(idx);
+    item_span target_in = in_buf[1]->get_item(idx);
 
     char* datum_out  = out_buf[0]->get_item(idx);
     char* target_out = out_buf[1]->get_item(idx);
@@ -47,11 +48,20 @@ void image_boundingbox::provide(int idx, buffer_in_array& in_buf, buffer_out_arr
         throw std::runtime_error(ss.str());
     }
 
+    telemetry::stopwatch timer;
     auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size());
+    timer.lap(telemetry::extract);
     auto image_params = image_factory.make_params(image_dec);
-    image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+    auto image_transformed = image_transformer.transform(image_params, image_dec);
+    timer.lap(telemetry::transform);
+    image_loader.load({datum_out}, image_transformed);
+    timer.lap(telemetry::load);
 
     // Process target data
     auto target_dec = bbox_extractor.extract(target_in.data(), target_in.size());
-    bbox_loader.load({target_out}, bbox_transformer.transform(image_params, target_dec));
+    timer.lap(telemetry::extract);
+    auto target_transformed = bbox_transformer.transform(image_params, target_dec);
+    timer.lap(telemetry::transform);
+    bbox_loader.load({target_out}, target_transformed);
+    timer.lap(telemetry::load);
 }
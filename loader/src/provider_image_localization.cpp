@@ -14,6 +14,7 @@
 */
 
 #include "provider_image_localization.hpp"
+#include "telemetry.hpp"
 
 using namespace nervana;
 using namespace std;
@@ -36,8 +37,8 @@ image_localization::image_localization(nlohmann::json js) :
 }
 
 void image_localization::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) {
-    vector<char>& datum_in  = in_buf[0]->get_item(idx);
-    vector<char>& target_in = in_buf[1]->get_item(idx);
+    item_span datum_in  = in_buf[0]->get_item(idx);
+    item_span target_in = in_buf[1]->get_item(idx);
 
     char* datum_out             = out_buf[0]->get_item(idx);
     char* y_bbtargets_out       = out_buf[1]->get_item(idx);
@@ -70,15 +71,24 @@ void image_localization::provide(int idx, buffer_in_array& in_buf, buffer_out_ar
         throw std::runtime_error(ss.str());
     }
 
+    telemetry::stopwatch timer;
     auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size());
+    timer.lap(telemetry::extract);
     if(image_dec) {
         auto image_params = image_factory.make_params(image_dec);
-        image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+        auto image_transformed = image_transformer.transform(image_params, image_dec);
+        timer.lap(telemetry::transform);
+        image_loader.load({datum_out}, image_transformed);
+        timer.lap(telemetry::load);
 
         // Process target data
         auto target_dec = localization_extractor.extract(target_in.data(), target_in.size());
+        timer.lap(telemetry::extract);
         if(target_dec) {
-            localization_loader.load(target_list, localization_transformer.transform(image_params, target_dec));
+            auto target_transformed = localization_transformer.transform(image_params, target_dec);
+            timer.lap(telemetry::transform);
+            localization_loader.load(target_list, target_transformed);
+            timer.lap(telemetry::load);
         }
     }
 }
@@ -14,6 +14,7 @@
 */
 
 #include "provider_image_only.hpp"
+#include "telemetry.hpp"
 
 using namespace nervana;
 using namespace std;
@@ -30,7 +31,7 @@ image_only::image_only(nlohmann::json js) :
 }
 
 void image_only::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf) {
-    std::vector<char>& datum_in  = in_buf[0]->get_item(idx);
+    item_span datum_in  = in_buf[0]->get_item(idx);
     char* datum_out  = out_buf[0]->get_item(idx);
 
     if (datum_in.size() == 0) {
@@ -40,7 +41,12 @@ void image_only::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out
     }
 
     // Process image data
+    telemetry::stopwatch timer;
     auto image_dec = image_extractor.extract(datum_in.data(), datum_in.size());
+    timer.lap(telemetry::extract);
     auto image_params = image_factory.make_params(image_dec);
-    image_loader.load({datum_out}, image_transformer.transform(image_params, image_dec));
+    auto image_transformed = image_transformer.transform(image_params, image_dec);
+    timer.lap(telemetry::transform);
+    image_loader.load({datum_out}, image_transformed);
+    timer.lap(telemetry::load);
 }
@@ -14,6 +14,7 @@
 */
 
 #include "provider_image_stereo.hpp"
+#include "telemetry.hpp"
 
 using namespace nervana;
 using namespace std;
@@ -37,24 +38,33 @@ image_stereo_blob::image_stereo_blob(nlohmann::json js) :
 
 void image_stereo_blob::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf)
 {
-    std::vector<char>& l_in      = in_buf[0]->get_item(idx);
-    std::vector<char>& r_in      = in_buf[1]->get_item(idx);
-    std::vector<char>& target_in = in_buf[2]->get_item(idx);
+    item_span l_in      = in_buf[0]->get_item(idx);
+    item_span r_in      = in_buf[1]->get_item(idx);
+    item_span target_in = in_buf[2]->get_item(idx);
 
     char* l_out                  = out_buf[0]->get_item(idx);
     char* r_out                  = out_buf[1]->get_item(idx);
     char* target_out             = out_buf[2]->get_item(idx);
 
+    telemetry::stopwatch timer;
     auto l_dec = image_extractor.extract(l_in.data(), l_in.size());
+    timer.lap(telemetry::extract);
     auto r_dec = image_extractor.extract(r_in.data(), r_in.size());
+    timer.lap(telemetry::extract);
     auto image_params = image_factory.make_params(l_dec);
     auto l_transformed = image_transformer.transform(image_params, l_dec);
+    timer.lap(telemetry::transform);
     auto r_transformed = image_transformer.transform(image_params, r_dec);
+    timer.lap(telemetry::transform);
     image_loader.load({l_out}, l_transformed);
+    timer.lap(telemetry::load);
     image_loader.load({r_out}, r_transformed);
+    timer.lap(telemetry::load);
 
     // Process target data
     auto target_dec = target_extractor.extract(target_in.data(), target_in.size());
+    timer.lap(telemetry::extract);
 //    auto target_transformed = target_transformer.transform(image_params, target_dec);
     target_loader.load({target_out}, target_dec);
+    timer.lap(telemetry::load);
 }
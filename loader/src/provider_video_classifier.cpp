@@ -14,6 +14,7 @@
 */
 
 #include "provider_video_classifier.hpp"
+#include "telemetry.hpp"
 
 using namespace nervana;
 using namespace std;
@@ -35,8 +36,8 @@ video_classifier::video_classifier(nlohmann::json js) :
 
 void video_classifier::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf)
 {
-    std::vector<char>& datum_in  = in_buf[0]->get_item(idx);
-    std::vector<char>& target_in = in_buf[1]->get_item(idx);
+    item_span datum_in  = in_buf[0]->get_item(idx);
+    item_span target_in = in_buf[1]->get_item(idx);
     char* datum_out  = out_buf[0]->get_item(idx);
     char* target_out = out_buf[1]->get_item(idx);
 
@@ -45,12 +46,19 @@ void video_classifier::provide(int idx, buffer_in_array& in_buf, buffer_out_arra
     }
 
     // Process video data
+    telemetry::stopwatch timer;
     auto video_dec = video_extractor.extract(datum_in.data(), datum_in.size());
+    timer.lap(telemetry::extract);
     auto frame_params = frame_factory.make_params(video_dec);
-    video_loader.load({datum_out}, video_transformer.transform(frame_params, video_dec));
+    auto video_transformed = video_transformer.transform(frame_params, video_dec);
+    timer.lap(telemetry::transform);
+    video_loader.load({datum_out}, video_transformed);
+    timer.lap(telemetry::load);
 
     // Process target data
     auto label_dec = label_extractor.extract(target_in.data(), target_in.size());
+    timer.lap(telemetry::extract);
     label_loader.load({target_out}, label_dec);
+    timer.lap(telemetry::load);
 }
 
@@ -14,6 +14,7 @@
 */
 
 #include "provider_video_only.hpp"
+#include "telemetry.hpp"
 
 using namespace nervana;
 using namespace std;
@@ -31,7 +32,7 @@ video_only::video_only(nlohmann::json js) :
 
 void video_only::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out_buf)
 {
-    std::vector<char>& datum_in  = in_buf[0]->get_item(idx);
+    item_span datum_in  = in_buf[0]->get_item(idx);
     char* datum_out  = out_buf[0]->get_item(idx);
 
     if (datum_in.size() == 0) {
@@ -41,7 +42,12 @@ void video_only::provide(int idx, buffer_in_array& in_buf, buffer_out_array& out
     }
 
     // Process video data
+    telemetry::stopwatch timer;
     auto video_dec = video_extractor.extract(datum_in.data(), datum_in.size());
+    timer.lap(telemetry::extract);
     auto frame_params = frame_factory.make_params(video_dec);
-    video_loader.load({datum_out}, video_transformer.transform(frame_params, video_dec));
+    auto video_transformed = video_transformer.transform(frame_params, video_dec);
+    timer.lap(telemetry::transform);
+    video_loader.load({datum_out}, video_transformed);
+    timer.lap(telemetry::load);
 }
@@ -20,6 +20,19 @@
 using namespace nervana;
 using namespace std;
 
+// numpy type of each output_type
+static const map<string, int> np_types {
+    {"int8_t",   NPY_INT8},
+    {"uint8_t",  NPY_UINT8},
+    {"int16_t",  NPY_INT16},
+    {"uint16_t", NPY_UINT16},
+    {"int32_t",  NPY_INT32},
+    {"uint32_t", NPY_UINT32},
+    {"float",    NPY_FLOAT32},
+    {"double",   NPY_FLOAT64},
+    {"char",     NPY_INT8}
+};
+
 python_backend::python_backend(PyObject* py_obj_backend)
 : _py_obj_backend(py_obj_backend)
 {
@@ -44,10 +57,12 @@ python_backend::python_backend(PyObject* py_obj_backend)
     PyGILState_Release(gstate);
 }
 
-void python_backend::setup_buffers(const vector<nervana::shape_type>& oshape_types, int batchSize)
+void python_backend::setup_buffers(const vector<nervana::shape_type>& oshape_types, int batchSize,
+                                   int bufferCount)
 {
     _oshape_types = oshape_types;
     _batchSize = batchSize;
+    _bufferCount = bufferCount;
 
     PyGILState_STATE gstate;
     gstate = PyGILState_Ensure();
@@ -59,8 +74,8 @@ void python_backend::setup_buffers(const vector<nervana::shape_type>& oshape_typ
 
     for (uint32_t i = 0; i < _oshape_types.size(); ++i)
     {
-        _host_lists.push_back(initPyList());
-        _dev_lists.push_back(initPyList());
+        _host_lists.push_back(initPyList(_bufferCount));
+        _dev_lists.push_back(initPyList(_bufferCount));
     }
 
     PyGILState_Release(gstate);
@@ -152,6 +167,7 @@ void python_backend::call_backend_transfer(buffer_out_array &outBuf, int bufIdx)
 
     affirm(_host_lists.size() == _oshape_types.size(), "host lists size does not match oshape size");
     affirm(_dev_lists.size() == _host_lists.size(), "dev list size does not match host lists size");
+    affirm(bufIdx >= 0 && bufIdx < _bufferCount, "buffer index out of range");
 
     for (uint32_t i=0; i<_host_lists.size(); i++) {
         wrap_buffer_pool(_host_lists[i], outBuf[i], bufIdx, _oshape_types[i]);
@@ -170,6 +186,24 @@ void python_backend::call_backend_transfer(buffer_out_array &outBuf, int bufIdx)
     PyGILState_Release(gstate);
 }
 
+PyObject* python_backend::consume(buffer_out_array &outBuf, int bufIdx)
+{
+    PyGILState_STATE gstate;
+    gstate = PyGILState_Ensure();
+
+    PyObject* result = nullptr;
+    try {
+        call_backend_transfer(outBuf, bufIdx);
+        result = get_host_tuple(bufIdx);
+    } catch (std::exception&) {
+        PyGILState_Release(gstate);
+        throw;
+    }
+
+    PyGILState_Release(gstate);
+    return result;
+}
+
 PyObject* python_backend::get_host_tuple(int bufIdx)
 {
     PyGILState_STATE gstate;
@@ -205,8 +239,12 @@ void python_backend::wrap_buffer_pool(PyObject *list, buffer_out *buf, int bufId
     if (hdItem == NULL) {
         throw std::runtime_error("Bad Index");
     }
+    // the host buffer behind a device buffer can change, e.g. after an error skipped a
+    // minibatch, so only reuse the array while it still wraps this one
     if (hdItem != Py_None) {
-        return;
+        if (PyArray_DATA(reinterpret_cast<PyArrayObject*>(hdItem)) == buf->data()) {
+            return;
+        }
     }
 
     // For now, we will collapse everything into two dimensions
@@ -220,7 +258,7 @@ void python_backend::wrap_buffer_pool(PyObject *list, buffer_out *buf, int bufId
         dims[1] = 1;
     }
 
-    PyObject *p_array = PyArray_SimpleNewFromData(nd, dims, st.get_otype().np_type, buf->data());
+    PyObject *p_array = PyArray_SimpleNewFromData(nd, dims, np_types.at(st.get_otype().tp_name), buf->data());
 
     if (p_array == NULL) {
         throw std::runtime_error("Unable to wrap buffer pool in as python object");
@@ -31,18 +31,22 @@ class nervana::python_backend {
 public:
     python_backend(PyObject*);
     ~python_backend();
-    void setup_buffers(const std::vector<nervana::shape_type>& oshape_types, int batchSize);
+    void setup_buffers(const std::vector<nervana::shape_type>& oshape_types, int batchSize,
+                       int bufferCount);
     void clear_buffers();
 
     bool use_pinned_memory();
     void call_backend_transfer(nervana::buffer_out_array &outBuf, int bufIdx);
     PyObject* get_host_tuple(int bufIdx);
+    // call_backend_transfer() then get_host_tuple(), taking the GIL once
+    PyObject* consume(nervana::buffer_out_array &outBuf, int bufIdx);
     PyObject* get_shapes();
     std::vector<nervana::shape_type> _oshape_types;
     int                         _batchSize;
+    int                         _bufferCount;
 private:
     python_backend() = delete;
-    PyObject* initPyList(int length=2);
+    PyObject* initPyList(int length);
     void wrap_buffer_pool(PyObject *list, nervana::buffer_out *buf, int bufIdx,
                           const nervana::shape_type& shape_type);
 
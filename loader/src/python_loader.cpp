@@ -0,0 +1,76 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "python_loader.hpp"
+
+using namespace std;
+using namespace nervana;
+
+python_loader::python_loader(const string& config, PyObject* py_obj_backend) :
+    loader(config),
+    _python_backend(make_shared<python_backend>(py_obj_backend))
+{
+}
+
+bool python_loader::use_pinned_memory()
+{
+    return _python_backend->use_pinned_memory();
+}
+
+void python_loader::setup(const vector<shape_type>& oshapes)
+{
+    _python_backend->setup_buffers(oshapes, batch_size(), device_buffer_count());
+}
+
+void python_loader::stop()
+{
+    loader::stop();
+    _holding = false;
+    _python_backend->clear_buffers();
+}
+
+int python_loader::reset()
+{
+    _holding = false;
+    return loader::reset();
+}
+
+PyObject* python_loader::next(int bufIdx)
+{
+    if (_holding) {
+        _holding = false;
+        loader::release();
+    }
+    const minibatch& batch = loader::next();
+    _holding = true;
+
+    telemetry::scope scope(&get_telemetry());
+    trace::span span("backend transfer", bufIdx);
+    auto start = chrono::steady_clock::now();
+    PyObject* result = _python_backend->consume(batch.buffers(), bufIdx);
+    get_telemetry().backend_transfer_ns.record(telemetry::elapsed_ns(start));
+    return result;
+}
+
+PyObject* python_loader::shapes()
+{
+    return _python_backend->get_shapes();
+}
+
+const char* python_loader::stats_c_str()
+{
+    _stats = stats();
+    return _stats.c_str();
+}
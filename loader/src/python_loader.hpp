@@ -0,0 +1,57 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <Python.h>
+
+#include "loader.hpp"
+#include "python_backend.hpp"
+
+namespace nervana {
+    class python_loader;
+}
+
+/* python_loader
+ *
+ * The loader behind the python DataLoader, a thin layer over loader.  next() hands each
+ * minibatch to the python backend's consume() on the caller's thread, taking the GIL once
+ * per minibatch, and returns the backend's buffers for it as a tuple.  The host buffers of
+ * a minibatch are only released on the following call to next(), since the backend may
+ * still be copying from them.
+ */
+class nervana::python_loader : public nervana::loader {
+public:
+    python_loader(const std::string& config, PyObject* py_obj_backend);
+
+    void stop();
+    int reset();
+    PyObject* next(int bufIdx);
+    PyObject* shapes();
+    // stats() kept for the C API, valid until the next call on this loader
+    const char* stats_c_str();
+
+protected:
+    bool use_pinned_memory() override;
+    void setup(const std::vector<nervana::shape_type>& oshapes) override;
+
+private:
+    python_loader() = delete;
+    python_loader(const python_loader&) = delete;
+
+    std::shared_ptr<python_backend>     _python_backend;
+    bool                                _holding = false;
+    std::string                         _stats;
+};
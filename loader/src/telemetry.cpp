@@ -0,0 +1,221 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "telemetry.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    thread_local telemetry* current_telemetry = nullptr;
+}
+
+int histogram::bucket(uint64_t value)
+{
+    if (value < 8) {
+        return value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    return 8 + (exponent - 3) * 4 + ((value >> (exponent - 2)) & 3);
+}
+
+uint64_t histogram::bucket_value(int bucket)
+{
+    // the middle of the bucket
+    if (bucket < 8) {
+        return bucket;
+    }
+    int exponent = (bucket - 8) / 4 + 3;
+    int sub      = (bucket - 8) % 4;
+    return (uint64_t(8 + 2 * sub + 1) << (exponent - 3));
+}
+
+void histogram::record(uint64_t value)
+{
+    _buckets[bucket(value)].fetch_add(1, memory_order_relaxed);
+    _count.fetch_add(1, memory_order_relaxed);
+    _sum.fetch_add(value, memory_order_relaxed);
+
+    uint64_t previous = _max.load(memory_order_relaxed);
+    while (value > previous &&
+           !_max.compare_exchange_weak(previous, value, memory_order_relaxed)) {
+    }
+}
+
+void histogram::reset()
+{
+    for (auto& b : _buckets) {
+        b = 0;
+    }
+    _count = 0;
+    _sum   = 0;
+    _max   = 0;
+}
+
+double histogram::mean() const
+{
+    uint64_t n = _count;
+    return n == 0 ? 0.0 : (double)_sum / n;
+}
+
+uint64_t histogram::percentile(double p) const
+{
+    uint64_t total = 0;
+    for (auto& b : _buckets) {
+        total += b;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p / 100.0 * (total - 1));
+    uint64_t seen = 0;
+    for (int i = 0; i < _bucketCount; i++) {
+        seen += _buckets[i];
+        if (seen > rank) {
+            return std::min(bucket_value(i), _max.load());
+        }
+    }
+    return _max;
+}
+
+nlohmann::json histogram::to_json(double scale) const
+{
+    nlohmann::json js;
+    js["count"] = count();
+    js["mean"]  = mean() * scale;
+    js["p50"]   = percentile(50) * scale;
+    js["p90"]   = percentile(90) * scale;
+    js["p99"]   = percentile(99) * scale;
+    js["max"]   = _max * scale;
+    return js;
+}
+
+telemetry* telemetry::current()
+{
+    return current_telemetry;
+}
+
+telemetry::scope::scope(telemetry* t)
+: _previous(current_telemetry)
+{
+    current_telemetry = t;
+}
+
+telemetry::scope::~scope()
+{
+    current_telemetry = _previous;
+}
+
+telemetry::stopwatch::stopwatch()
+: _telemetry(current_telemetry)
+{
+    if (_telemetry != nullptr) {
+        _last = chrono::steady_clock::now();
+    }
+}
+
+telemetry::stopwatch::~stopwatch()
+{
+    if (_telemetry == nullptr) {
+        return;
+    }
+    for (int s = 0; s < stage_count; s++) {
+        if (_used[s]) {
+            _telemetry->stage_ns[s].record(_elapsed[s]);
+        }
+    }
+}
+
+void telemetry::stopwatch::lap(stage s)
+{
+    if (_telemetry == nullptr) {
+        return;
+    }
+    auto now = chrono::steady_clock::now();
+    _elapsed[s] += chrono::duration_cast<chrono::nanoseconds>(now - _last).count();
+    _used[s]     = true;
+    _last        = now;
+}
+
+void telemetry::reset()
+{
+    block_load_ns.reset();
+    cache_hits           = 0;
+    cache_misses         = 0;
+    cache_writes_dropped = 0;
+    cache_evictions      = 0;
+    cache_read_ns.reset();
+    cache_write_ns.reset();
+    for (auto& h : stage_ns) {
+        h.reset();
+    }
+    provide_ns.reset();
+    post_process_ns.reset();
+    backend_transfer_ns.reset();
+    next_wait_ns.reset();
+    minibatches = 0;
+    read_queue.reset();
+    decode_queue.reset();
+}
+
+string telemetry::bottleneck() const
+{
+    // Minibatches pile up in front of the slowest stage.  Decoded ones
+    // waiting means the consumer can't keep up, read ones waiting means
+    // decoding can't, and neither means we are waiting on I/O.
+    if (decode_queue.count() == 0 || read_queue.count() == 0) {
+        return "unknown";
+    }
+    if (decode_queue.mean() >= 0.5 * decode_queue_depth) {
+        return "consumer";
+    }
+    if (read_queue.mean() >= 0.5 * read_queue_depth) {
+        return "decode";
+    }
+    return "io";
+}
+
+nlohmann::json telemetry::snapshot() const
+{
+    const double us = 1e-3;
+    nlohmann::json js;
+
+    js["read"]["block_load_us"]     = block_load_ns.to_json(us);
+    js["read"]["cache_hits"]        = cache_hits.load();
+    js["read"]["cache_misses"]      = cache_misses.load();
+    js["read"]["cache_writes_dropped"] = cache_writes_dropped.load();
+    js["read"]["cache_evictions"]   = cache_evictions.load();
+    js["read"]["cache_read_us"]     = cache_read_ns.to_json(us);
+    js["read"]["cache_write_us"]    = cache_write_ns.to_json(us);
+
+    js["decode"]["extract_us"]          = stage_ns[extract].to_json(us);
+    js["decode"]["transform_us"]        = stage_ns[transform].to_json(us);
+    js["decode"]["load_us"]             = stage_ns[load].to_json(us);
+    js["decode"]["provide_us"]          = provide_ns.to_json(us);
+    js["decode"]["post_process_us"]     = post_process_ns.to_json(us);
+
+    js["queues"]["read"]                = read_queue.to_json();
+    js["queues"]["read"]["depth"]       = read_queue_depth;
+    js["queues"]["decode"]              = decode_queue.to_json();
+    js["queues"]["decode"]["depth"]     = decode_queue_depth;
+
+    js["consumer"]["next_wait_us"]          = next_wait_ns.to_json(us);
+    js["consumer"]["backend_transfer_us"]   = backend_transfer_ns.to_json(us);
+    js["consumer"]["minibatches"]           = minibatches.load();
+
+    js["bottleneck"] = bottleneck();
+    return js;
+}
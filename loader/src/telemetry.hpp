@@ -0,0 +1,153 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "json.hpp"
+
+namespace nervana {
+    class histogram;
+    class telemetry;
+    class trace;
+}
+
+/* histogram
+ *
+ * A lock-free histogram of non-negative integer samples.  Values below 8
+ * get a bucket each, larger values are bucketed with four buckets per
+ * power of two, so percentiles are accurate to within 12.5%.
+ */
+class nervana::histogram {
+public:
+    histogram() { reset(); }
+
+    void     record(uint64_t value);
+    void     reset();
+    uint64_t count() const { return _count; }
+    double   mean() const;
+    uint64_t percentile(double p) const;
+
+    // count, mean, p50, p90, p99 and max, with values multiplied by `scale`
+    nlohmann::json to_json(double scale = 1.0) const;
+
+private:
+    histogram(const histogram&) = delete;
+
+    static int      bucket(uint64_t value);
+    static uint64_t bucket_value(int bucket);
+
+    static constexpr int    _bucketCount = 252;
+    std::atomic<uint64_t>   _buckets[_bucketCount];
+    std::atomic<uint64_t>   _count;
+    std::atomic<uint64_t>   _sum;
+    std::atomic<uint64_t>   _max;
+};
+
+/* telemetry
+ *
+ * Counters and histograms for every stage of one loader's pipeline.
+ *
+ * Code deep inside the pipeline (block loaders, providers) doesn't know
+ * which loader it is working for, so every pipeline thread makes its
+ * loader's telemetry current for as long as it works for that loader, with
+ * a telemetry::scope.  Recording is a no-op on threads with no current
+ * telemetry.
+ *
+ * Times are recorded in nanoseconds and reported in microseconds.
+ *
+ * When tracing is on, `tracer` is where trace::span records events.
+ */
+class nervana::telemetry {
+public:
+    enum stage {
+        extract,
+        transform,
+        load,
+        stage_count
+    };
+
+    telemetry() {}
+
+    // read thread
+    histogram               block_load_ns;
+    std::atomic<uint64_t>   cache_hits{0};
+    std::atomic<uint64_t>   cache_misses{0};
+    std::atomic<uint64_t>   cache_writes_dropped{0};
+    std::atomic<uint64_t>   cache_evictions{0};
+    histogram               cache_read_ns;
+    histogram               cache_write_ns;
+
+    // decode
+    histogram               stage_ns[stage_count];
+    histogram               provide_ns;
+    histogram               post_process_ns;
+
+    // consumer
+    histogram               next_wait_ns;
+    histogram               backend_transfer_ns;
+    std::atomic<uint64_t>   minibatches{0};
+
+    // minibatches waiting in each buffer pool, sampled once per minibatch
+    histogram               read_queue;
+    histogram               decode_queue;
+    int                     read_queue_depth    = 0;
+    int                     decode_queue_depth  = 0;
+
+    nervana::trace*         tracer              = nullptr;
+
+    nlohmann::json snapshot() const;
+    void           reset();
+
+    static telemetry* current();
+
+    // makes `t` current on this thread until the scope ends
+    class scope {
+    public:
+        explicit scope(telemetry* t);
+        ~scope();
+    private:
+        telemetry* _previous;
+    };
+
+    // Splits the time spent on one item between the extract, transform and
+    // load stages.  Each call to lap() charges the time since the previous
+    // lap to a stage, and the totals are recorded when the stopwatch goes
+    // out of scope.
+    class stopwatch {
+    public:
+        stopwatch();
+        ~stopwatch();
+        void lap(stage s);
+    private:
+        telemetry*                              _telemetry;
+        std::chrono::steady_clock::time_point   _last;
+        uint64_t                                _elapsed[stage_count] = {};
+        bool                                    _used[stage_count] = {};
+    };
+
+    static uint64_t elapsed_ns(const std::chrono::steady_clock::time_point& start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    telemetry(const telemetry&) = delete;
+    std::string bottleneck() const;
+};
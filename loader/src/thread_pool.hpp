@@ -24,6 +24,7 @@
 #include <chrono>
 #include <utility>
 #include <algorithm>
+#include <atomic>
 
 namespace nervana {
     class thread_pool;
@@ -35,23 +36,19 @@ namespace nervana {
  * using std::thread.  Methods are provided to start, stop and join all
  * N threads simultaneously.
  *
+ * stop() only asks the threads to finish.  Derived classes must make sure
+ * that a thread blocked inside work() is woken up, after which join() waits
+ * for all of them to exit.
+ *
  */
 class nervana::thread_pool {
 public:
     explicit thread_pool(int count)
     : _count(count), _done(false) {
-        _stopped = new bool[count];
-        for (int i = 0; i < count; i++) {
-            _stopped[i] = false;
-        }
     }
 
     virtual ~thread_pool() {
-        for (auto t : _threads) {
-            t->join();
-            delete t;
-        }
-        delete[] _stopped;
+        join();
     }
 
     virtual void start() {
@@ -64,19 +61,12 @@ public:
         _done = true;
     }
 
-    bool stopped() {
-        for (int i = 0; i < _count; i++) {
-            if (_stopped[i] == false) {
-                return false;
-            }
-        }
-        return true;
-    }
-
     void join() {
         for (auto t : _threads) {
             t->join();
+            delete t;
         }
+        _threads.clear();
     }
 
 protected:
@@ -86,12 +76,10 @@ protected:
         while (_done == false) {
             work(id);
         }
-        _stopped[id] = true;
     }
 
 protected:
     int                         _count;
     std::vector<std::thread*>   _threads;
-    bool                        _done;
-    bool*                       _stopped;
+    std::atomic<bool>           _done;
 };
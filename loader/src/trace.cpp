@@ -0,0 +1,189 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <fstream>
+#include <algorithm>
+#include <tuple>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "trace.hpp"
+#include "telemetry.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    atomic<uint64_t> next_trace_id{1};
+
+    // rings this thread has recorded into, most recent last.  Traces are
+    // identified by id rather than address since an address can be reused
+    // by a later trace.
+    struct cached_ring {
+        uint64_t    trace_id;
+        void*       r;
+    };
+    thread_local vector<cached_ring> thread_rings;
+    thread_local string              thread_name;
+
+    const size_t max_cached_rings = 8;
+}
+
+trace::trace(size_t events_per_thread)
+: _id(next_trace_id++),
+  _capacity(events_per_thread),
+  _start(chrono::steady_clock::now())
+{
+    affirm(_capacity > 0, "trace events_per_thread must be > 0");
+}
+
+void trace::set_thread_name(const string& name)
+{
+    thread_name = name;
+}
+
+uint64_t trace::now_ns() const
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - _start).count();
+}
+
+trace::ring* trace::thread_ring()
+{
+    for (auto& c : thread_rings) {
+        if (c.trace_id == _id) {
+            return static_cast<ring*>(c.r);
+        }
+    }
+
+    ring* r;
+    {
+        lock_guard<mutex> lock(_mutex);
+        // a thread which records into more traces than it caches comes back
+        // to its ring here
+        ring*& found = _thread_rings[this_thread::get_id()];
+        if (found == nullptr) {
+            _rings.emplace_back(new ring);
+            found              = _rings.back().get();
+            found->tid         = _rings.size();
+            found->thread_name = thread_name.empty() ? "thread " + to_string(found->tid) : thread_name;
+            found->events      = unique_ptr<event[]>(new event[_capacity]);
+        }
+        r = found;
+    }
+
+    if (thread_rings.size() == max_cached_rings) {
+        thread_rings.erase(thread_rings.begin());
+    }
+    thread_rings.push_back({_id, r});
+    return r;
+}
+
+void trace::record(const char* name, uint64_t begin_ns, uint64_t end_ns, int64_t arg)
+{
+    ring*    r = thread_ring();
+    uint64_t h = r->head.load(memory_order_relaxed);
+    event&   e = r->events[h % _capacity];
+    e.name.store(name, memory_order_relaxed);
+    e.begin.store(begin_ns, memory_order_relaxed);
+    e.end.store(end_ns, memory_order_relaxed);
+    e.arg.store(arg, memory_order_relaxed);
+    r->head.store(h + 1, memory_order_release);
+}
+
+void trace::dump(const string& filename)
+{
+    ofstream out(filename);
+    if (!out) {
+        throw runtime_error("unable to open trace file " + filename);
+    }
+
+    vector<ring*> rings;
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (auto& r : _rings) {
+            rings.push_back(r.get());
+        }
+    }
+
+    int pid = getpid();
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) {
+            out << ",\n";
+        }
+        first = false;
+    };
+
+    out.setf(ios::fixed);
+    out.precision(3);
+    for (ring* r : rings) {
+        separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+            << ",\"tid\":" << r->tid << ",\"args\":{\"name\":\"" << r->thread_name << "\"}}";
+
+        uint64_t head  = r->head.load(memory_order_acquire);
+        uint64_t begin = head > _capacity ? head - _capacity : 0;
+        vector<tuple<const char*, uint64_t, uint64_t, int64_t>> events;
+        for (uint64_t i = begin; i < head; i++) {
+            event& e = r->events[i % _capacity];
+            events.emplace_back(e.name.load(memory_order_relaxed),
+                                e.begin.load(memory_order_relaxed),
+                                e.end.load(memory_order_relaxed),
+                                e.arg.load(memory_order_relaxed));
+        }
+
+        // The thread kept recording while we copied.  Anything it may have
+        // overwritten, including the slot it may be writing right now, is
+        // dropped.
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t now   = r->head.load(memory_order_relaxed);
+        uint64_t valid = now + 1 > _capacity ? now + 1 - _capacity : 0;
+
+        for (uint64_t i = std::max(begin, valid); i < head; i++) {
+            auto& e = events[i - begin];
+            separator();
+            out << "{\"name\":\"" << get<0>(e) << "\",\"ph\":\"X\",\"pid\":" << pid
+                << ",\"tid\":" << r->tid
+                << ",\"ts\":" << get<1>(e) / 1000.0
+                << ",\"dur\":" << (get<2>(e) - get<1>(e)) / 1000.0;
+            if (get<3>(e) >= 0) {
+                out << ",\"args\":{\"n\":" << get<3>(e) << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+}
+
+trace::span::span(const char* name, int64_t arg)
+: _trace(nullptr),
+  _name(name),
+  _arg(arg)
+{
+    telemetry* t = telemetry::current();
+    if (t != nullptr && t->tracer != nullptr) {
+        _trace = t->tracer;
+        _begin = _trace->now_ns();
+    }
+}
+
+trace::span::~span()
+{
+    if (_trace != nullptr) {
+        _trace->record(_name, _begin, _trace->now_ns(), _arg);
+    }
+}
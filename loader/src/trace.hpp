@@ -0,0 +1,102 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nervana {
+    class trace;
+}
+
+/* trace
+ *
+ * A timeline of what every loader thread was doing, written out in the
+ * Chrome trace event format for chrome://tracing or Perfetto.
+ *
+ * Each thread records into its own ring of `events_per_thread` events, so
+ * recording takes no lock and only the most recent events of each thread
+ * are kept.  A thread's ring is created the first time it records, and
+ * found again under the lock if it has dropped out of the thread's cache
+ * of recent rings.
+ *
+ * Events are recorded with a trace::span, which covers the scope it lives
+ * in.  Spans record into the trace of the telemetry current on the thread
+ * (see telemetry::scope), and cost a thread local lookup when tracing is
+ * off.  Span names must be string literals since only the pointer is kept.
+ *
+ * dump() may be called while threads are recording.  Events overwritten
+ * while it runs are left out.
+ */
+class nervana::trace {
+public:
+    explicit trace(size_t events_per_thread = 16384);
+
+    void     record(const char* name, uint64_t begin_ns, uint64_t end_ns, int64_t arg);
+    uint64_t now_ns() const;
+    void     dump(const std::string& filename);
+
+    // names the calling thread in every trace it records into from now on
+    static void set_thread_name(const std::string& name);
+
+    class span {
+    public:
+        // `arg`, if not negative, is shown with the event, e.g. an item index
+        explicit span(const char* name, int64_t arg = -1);
+        ~span();
+    private:
+        span(const span&) = delete;
+        trace*      _trace;
+        const char* _name;
+        int64_t     _arg;
+        uint64_t    _begin;
+    };
+
+private:
+    trace(const trace&) = delete;
+
+    // fields are atomic only so that dump() can read a ring while its
+    // thread is writing it
+    struct event {
+        std::atomic<const char*>    name{nullptr};
+        std::atomic<uint64_t>       begin{0};
+        std::atomic<uint64_t>       end{0};
+        std::atomic<int64_t>        arg{-1};
+    };
+
+    struct ring {
+        std::string                 thread_name;
+        int                         tid;
+        std::unique_ptr<event[]>    events;
+        std::atomic<uint64_t>       head{0};    // events ever recorded
+    };
+
+    ring* thread_ring();
+
+    uint64_t                                _id;
+    size_t                                  _capacity;
+    std::chrono::steady_clock::time_point   _start;
+    std::mutex                              _mutex;
+    std::vector<std::unique_ptr<ring>>      _rings;     // guarded by _mutex
+    std::map<std::thread::id, ring*>        _thread_rings;  // guarded by _mutex
+};
@@ -0,0 +1,110 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+// Measures how well buffer_pool_in absorbs producer jitter as the pool depth
+// grows.  The producer normally takes `produce_us` per buffer, but with
+// probability `spike_rate` it takes `spike_us` instead (a huge JPEG, a slow
+// NFS read).  The consumer takes a fixed `consume_us` per buffer.  Any time
+// the consumer spends waiting for a buffer is a stall of the training loop.
+// Work is simulated with sleeps so the numbers don't depend on core count.
+//
+// usage: bench_buffer_pool [count] [produce_us] [consume_us] [spike_us] [spike_rate]
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+#include "buffer_pool_in.hpp"
+
+using namespace std;
+using namespace nervana;
+
+struct result {
+    double stall_ms;
+    double total_ms;
+    int    stalled_buffers;
+};
+
+static result run(int depth, int count, int produce_us, int consume_us, int spike_us, double spike_rate)
+{
+    buffer_pool_in pool(1, depth);
+
+    thread producer([&]() {
+        // same seed for every depth so each run sees identical jitter
+        mt19937 rng(0);
+        bernoulli_distribution spike(spike_rate);
+        vector<char> item(16);
+        for (int i = 0; i < count; i++) {
+            this_thread::sleep_for(chrono::microseconds(spike(rng) ? spike_us : produce_us));
+            pool.wait_for_not_full();
+            pool.get_for_write()[0]->add_item(item);
+            pool.advance_write_pos();
+        }
+    });
+
+    result rc = {0.0, 0.0, 0};
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        auto wait_start = chrono::steady_clock::now();
+        pool.wait_for_not_empty();
+        double waited = chrono::duration<double, milli>(chrono::steady_clock::now() - wait_start).count();
+
+        // the first buffer is pipeline fill, not a stall
+        if (i > 0) {
+            rc.stall_ms += waited;
+            if (waited > consume_us / 1000.0) {
+                rc.stalled_buffers++;
+            }
+        }
+
+        pool.get_for_read();
+        this_thread::sleep_for(chrono::microseconds(consume_us));
+        pool.advance_read_pos();
+    }
+    rc.total_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    producer.join();
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    int    count      = argc > 1 ? atoi(argv[1]) : 2000;
+    int    produce_us = argc > 2 ? atoi(argv[2]) : 100;
+    int    consume_us = argc > 3 ? atoi(argv[3]) : 150;
+    int    spike_us   = argc > 4 ? atoi(argv[4]) : 2000;
+    double spike_rate = argc > 5 ? atof(argv[5]) : 0.02;
+
+    cout << "buffers " << count << ", produce " << produce_us << "us, consume " << consume_us
+         << "us, spike " << spike_us << "us at rate " << spike_rate << endl;
+    cout << setw(8) << "depth" << setw(14) << "total_ms" << setw(14) << "stall_ms"
+         << setw(12) << "stall_%" << setw(18) << "stalled_buffers" << endl;
+
+    for (int depth : {1, 2, 4, 8, 16, 32}) {
+        result r = run(depth, count, produce_us, consume_us, spike_us, spike_rate);
+        cout << setw(8) << depth
+             << setw(14) << fixed << setprecision(1) << r.total_ms
+             << setw(14) << r.stall_ms
+             << setw(12) << setprecision(2) << 100.0 * r.stall_ms / r.total_ms
+             << setw(18) << r.stalled_buffers << endl;
+    }
+
+    return 0;
+}
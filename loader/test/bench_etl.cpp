@@ -0,0 +1,384 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+// Microbenchmarks for the individual ETL stages, so that a regression in one
+// extractor, transformer or loader shows up on its own rather than being
+// diluted in an end to end run.
+//
+// Every benchmark is run once to warm up, then `repetitions` times for at
+// least `min_time` seconds each.  The median over the repetitions is
+// reported, in JSON on stdout (or to `output`), as ns/item and items/sec.
+// Progress goes to stderr.
+//
+// Images come from gen_image, audio from a synthesized sine wave and video
+// and localization metadata from test_data, with fixed random seeds, so
+// runs are comparable between releases.
+//
+// usage: bench_etl [-f filter] [-t min_time] [-r repetitions] [-o output]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "json.hpp"
+#include "gen_image.hpp"
+#include "cpio.hpp"
+#include "buffer_in.hpp"
+#include "etl_image.hpp"
+#include "etl_audio.hpp"
+#include "etl_video.hpp"
+#include "etl_localization.hpp"
+#include "specgram.hpp"
+#include "wav_data.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    string          filter;
+    double          min_time    = 1.0;
+    int             repetitions = 3;
+    nlohmann::json  results     = nlohmann::json::array();
+
+    // `run` processes a batch of items and returns how many
+    void measure(const string& name, const function<size_t()>& run)
+    {
+        if (!filter.empty() && name.find(filter) == string::npos) {
+            return;
+        }
+
+        // lazily built tables, first touch of buffers and so on
+        run();
+
+        vector<double> ns_per_item;
+        uint64_t       items = 0;
+        for (int r = 0; r < repetitions; r++) {
+            items = 0;
+            double elapsed = 0;
+            auto   start   = chrono::steady_clock::now();
+            do {
+                items  += run();
+                elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            } while (elapsed < min_time);
+            ns_per_item.push_back(elapsed * 1e9 / items);
+        }
+        sort(ns_per_item.begin(), ns_per_item.end());
+        double median = ns_per_item[ns_per_item.size() / 2];
+
+        nlohmann::json js;
+        js["name"]              = name;
+        js["items"]             = items;
+        js["ns_per_item"]       = median;
+        js["min_ns_per_item"]   = ns_per_item.front();
+        js["max_ns_per_item"]   = ns_per_item.back();
+        js["items_per_sec"]     = 1e9 / median;
+        results.push_back(js);
+
+        cerr << name << ": " << (uint64_t)median << " ns/item, "
+             << (uint64_t)(1e9 / median) << " items/sec" << endl;
+    }
+
+    string read_file(const string& path)
+    {
+        ifstream f(path, ios::binary);
+        if (!f) {
+            throw runtime_error("unable to read " + path);
+        }
+        stringstream ss;
+        ss << f.rdbuf();
+        return ss.str();
+    }
+
+    // reads the datum and target of every item in a gen_image cpio file
+    void read_cpio(const string& path, buffer_in& images, buffer_in& targets)
+    {
+        cpio::file_reader reader;
+        if (!reader.open(path)) {
+            throw runtime_error("unable to open " + path);
+        }
+        for (int i = 0; i < reader.itemCount(); i++) {
+            reader.read(images);
+            reader.read(targets);
+        }
+        reader.close();
+    }
+
+    void bench_image(const vector<string>& cpio_files)
+    {
+        buffer_in png;
+        buffer_in targets;
+        read_cpio(cpio_files[0], png, targets);
+        int count = png.get_item_count();
+
+        // the same images as JPEGs, which is what most datasets hold
+        vector<vector<char>> jpg;
+        for (int i = 0; i < count; i++) {
+            item_span item = png.get_item(i);
+            cv::Mat mat = cv::imdecode(cv::Mat(1, item.size(), CV_8UC1, item.data()), CV_LOAD_IMAGE_COLOR);
+            vector<unsigned char> encoded;
+            cv::imencode(".jpg", mat, encoded);
+            jpg.emplace_back(encoded.begin(), encoded.end());
+        }
+
+        nlohmann::json base = {{"height", 224}, {"width", 224}};
+        {
+            image::config    cfg(base);
+            image::extractor extractor(cfg);
+            int i = 0;
+            measure("image.extract.png_256x256", [&]() {
+                item_span item = png.get_item(i++ % count);
+                extractor.extract(item.data(), item.size());
+                return 1;
+            });
+            measure("image.extract.jpeg_256x256", [&]() {
+                vector<char>& item = jpg[i++ % count];
+                extractor.extract(item.data(), item.size());
+                return 1;
+            });
+        }
+
+        // transform, including drawing the random parameters for the item
+        vector<pair<string, nlohmann::json>> augmentations = {
+            {"resize", {{"crop_enable", false}}},
+            {"center_crop", nlohmann::json::object()},
+            {"random_crop_flip", {{"center", false}, {"scale", {0.5, 1.0}}, {"flip_enable", true}}},
+            {"full", {{"center", false},
+                      {"scale", {0.5, 1.0}},
+                      {"flip_enable", true},
+                      {"angle", {-10, 10}},
+                      {"lighting", {0.0, 0.1}},
+                      {"horizontal_distortion", {0.75, 1.33}},
+                      {"contrast", {0.9, 1.1}},
+                      {"brightness", {0.9, 1.1}},
+                      {"saturation", {0.9, 1.1}},
+                      {"hue", {-10, 10}}}},
+        };
+        for (auto& a : augmentations) {
+            nlohmann::json js = base;
+            for (auto it = a.second.begin(); it != a.second.end(); ++it) {
+                js[it.key()] = it.value();
+            }
+            image::config        cfg(js);
+            image::extractor     extractor(cfg);
+            image::param_factory factory(cfg);
+            image::transformer   transformer(cfg);
+
+            vector<shared_ptr<image::decoded>> decoded;
+            for (int i = 0; i < count; i++) {
+                decoded.push_back(extractor.extract(jpg[i].data(), jpg[i].size()));
+            }
+            int i = 0;
+            measure("image.transform." + a.first, [&]() {
+                auto& d = decoded[i++ % count];
+                transformer.transform(factory.make_params(d), d);
+                return 1;
+            });
+        }
+
+        for (bool channel_major : {true, false}) {
+            nlohmann::json js = base;
+            js["channel_major"] = channel_major;
+            image::config        cfg(js);
+            image::extractor     extractor(cfg);
+            image::param_factory factory(cfg);
+            image::transformer   transformer(cfg);
+            image::loader        loader(cfg);
+
+            auto d = extractor.extract(jpg[0].data(), jpg[0].size());
+            auto t = transformer.transform(factory.make_params(d), d);
+            vector<char> out(cfg.get_shape_type().get_byte_size());
+            measure(string("image.load.") + (channel_major ? "channel_major" : "channel_minor"), [&]() {
+                loader.load({out.data()}, t);
+                return 1;
+            });
+        }
+    }
+
+    void bench_cpio(const vector<string>& cpio_files)
+    {
+        measure("cpio.file_reader", [&]() {
+            buffer_in images;
+            buffer_in targets;
+            read_cpio(cpio_files[0], images, targets);
+            return images.get_item_count();
+        });
+        measure("cpio.mmap_reader", [&]() {
+            buffer_in images;
+            buffer_in targets;
+            cpio::mmap_reader reader;
+            if (!reader.open(cpio_files[0])) {
+                throw runtime_error("unable to map " + cpio_files[0]);
+            }
+            for (int i = 0; i < reader.itemCount(); i++) {
+                reader.read(images);
+                reader.read(targets);
+            }
+            return images.get_item_count();
+        });
+    }
+
+    void bench_audio()
+    {
+        // two seconds of a 400Hz tone at 16kHz
+        sinewave_generator sg{400, 500};
+        wav_data wav(sg, 2, 16000, false);
+        vector<char> buf(wav_data::HEADER_SIZE + wav.nbytes());
+        wav.write_to_buffer(buf.data(), buf.size());
+
+        {
+            // 20ms frames every 10ms
+            int frame_length = 320;
+            int frame_stride = 160;
+            int time_steps   = (2 * 16000 - frame_length) / frame_stride + 1;
+            cv::Mat window;
+            specgram::create_window("hann", frame_length, window);
+            cv::Mat spec;
+            measure("audio.wav_to_specgram", [&]() {
+                specgram::wav_to_specgram(wav.get_data(), frame_length, frame_stride, time_steps, window, spec);
+                return 1;
+            });
+        }
+
+        audio::extractor extractor;
+        measure("audio.extract", [&]() {
+            extractor.extract(buf.data(), buf.size());
+            return 1;
+        });
+
+        // transform works in place, so these include extracting the item
+        for (string feature_type : {"specgram", "mfsc", "mfcc"}) {
+            nlohmann::json js = {
+                {"max_duration", "2000 milliseconds"},
+                {"frame_length", "320 samples"},
+                {"frame_stride", "160 samples"},
+                {"sample_freq_hz", 16000},
+                {"feature_type", feature_type},
+                {"num_filters", 64}
+            };
+            audio::config        cfg(js);
+            audio::param_factory factory(cfg);
+            audio::transformer   transformer(cfg);
+            measure("audio.extract_transform." + feature_type, [&]() {
+                auto d = extractor.extract(buf.data(), buf.size());
+                transformer.transform(factory.make_params(d), d);
+                return 1;
+            });
+        }
+    }
+
+    void bench_video()
+    {
+        string data = read_file(CURDIR"/test_data/bb8.avi");
+        nlohmann::json js = {{"max_frame_count", 5},
+                             {"frame", {{"height", 224}, {"width", 224}}}};
+        video::config    cfg(js);
+        video::extractor extractor(cfg);
+        measure("video.extract.mjpeg", [&]() {
+            extractor.extract(data.data(), data.size());
+            return 1;
+        });
+    }
+
+    void bench_localization()
+    {
+        string metadata = read_file(CURDIR"/test_data/006637.json");
+        nlohmann::json meta = nlohmann::json::parse(metadata);
+        cv::Mat blank((int)meta["size"]["height"], (int)meta["size"]["width"], CV_8UC3, cv::Scalar(0, 0, 0));
+        vector<unsigned char> image_data;
+        cv::imencode(".png", blank, image_data);
+
+        nlohmann::json ijs = {
+            {"width", 1000},
+            {"height", 1000},
+            {"flip_enable", true},
+            {"crop_enable", false},
+            {"fixed_aspect_ratio", true},
+            {"fixed_scaling_factor", 1.6}
+        };
+        image::config        icfg(ijs);
+        image::extractor     image_extractor(icfg);
+        image::param_factory factory(icfg);
+        auto image_decoded = image_extractor.extract((const char*)image_data.data(), image_data.size());
+
+        nlohmann::json ljs = {
+            {"class_names", {"person", "bicycle"}},
+            {"max_gt_boxes", 64}
+        };
+        localization::config      cfg(ljs, icfg);
+        localization::extractor   extractor(cfg);
+        localization::transformer transformer(cfg);
+        auto decoded = extractor.extract(&metadata[0], metadata.size());
+        measure("localization.transform", [&]() {
+            transformer.transform(factory.make_params(image_decoded), decoded);
+            return 1;
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    string output;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:r:o:")) != -1) {
+        switch (opt) {
+        case 'f': filter      = optarg; break;
+        case 't': min_time    = atof(optarg); break;
+        case 'r': repetitions = max(1, atoi(optarg)); break;
+        case 'o': output      = optarg; break;
+        default:
+            cerr << "usage: " << argv[0] << " [-f filter] [-t min_time] [-r repetitions] [-o output]" << endl;
+            return 1;
+        }
+    }
+
+    char dir[] = "/tmp/aeon_bench_XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        cerr << "unable to create a temporary directory" << endl;
+        return 1;
+    }
+    gen_image images;
+    images.Directory(dir).Prefix("bench-").MacrobatchMaxItems(64).DatasetSize(64).ImageSize(256, 256).Create();
+
+    bench_image(images.GetFiles());
+    bench_cpio(images.GetFiles());
+    bench_audio();
+    bench_video();
+    bench_localization();
+
+    images.Delete();
+
+    nlohmann::json js;
+    js["context"]["date"]        = (uint64_t)time(nullptr);
+    js["context"]["min_time"]    = min_time;
+    js["context"]["repetitions"] = repetitions;
+    js["benchmarks"]             = results;
+    if (output.empty()) {
+        cout << js.dump(4) << endl;
+    } else {
+        ofstream(output) << js.dump(4) << endl;
+    }
+    return 0;
+}
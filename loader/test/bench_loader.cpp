@@ -0,0 +1,394 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+// End to end soak benchmark for the loader.
+//
+// Drives an image,label loader over a generated manifest of random JPEGs,
+// with the cpio cache primed beforehand, from a fake consumer which holds
+// each minibatch for `consume_us` microseconds, like a training step would.
+// Reports time to first batch, steady state items/sec and the latency of
+// next(), as JSON on stdout (or to `output`).
+//
+// Modes:
+//   full    the whole nervana::loader
+//   io      only the read thread, reading minibatches from the cache
+//   decode  read and decode, with the blocks replayed from RAM, so no I/O
+//
+// Comparing the three shows whether a box is bound by I/O or by decoding.
+//
+// usage: bench_loader [-m full|io|decode] [-n items] [-s image_size]
+//                     [-b minibatch_size] [-i batches] [-w warmup_batches]
+//                     [-c consume_us] [-t decode_threads] [-o output]
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <ctime>
+#include <numeric>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "json.hpp"
+#include "loader.hpp"
+#include "cache_warmer.hpp"
+#include "block_iterator_sequential.hpp"
+#include "batch_iterator.hpp"
+#include "buffer_pool_in.hpp"
+#include "buffer_pool_out.hpp"
+#include "provider_factory.hpp"
+#include "decode_executor.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    string  mode            = "full";
+    int     item_count      = 2048;
+    int     image_size      = 256;
+    int     minibatch_size  = 64;
+    int     batches         = 200;
+    int     warmup_batches  = 10;
+    int     consume_us      = 0;
+    int     decode_threads  = 0;
+
+    // Serves the blocks of another block_loader from memory.  The items are
+    // shared with the destination rather than copied.
+    class block_loader_memory : public block_loader {
+    public:
+        block_loader_memory(const shared_ptr<block_loader>& source)
+        : block_loader(source->blockSize()),
+          _objectCount(source->objectCount())
+        {
+            for (uint32_t i = 0; i < source->blockCount(); i++) {
+                _blocks.emplace_back(new buffer_in_array(2));
+                source->loadBlock(*_blocks.back(), i);
+            }
+        }
+
+        void loadBlock(buffer_in_array& dest, uint32_t block_num) override
+        {
+            buffer_in_array& src = *_blocks[block_num];
+            for (size_t i = 0; i < src.size(); i++) {
+                for (int j = 0; j < src[i]->get_item_count(); j++) {
+                    dest[i]->share_item(*src[i], j);
+                }
+            }
+        }
+
+        uint32_t objectCount() override { return _objectCount; }
+
+    private:
+        uint32_t                                _objectCount;
+        vector<unique_ptr<buffer_in_array>>     _blocks;
+    };
+
+    // removes a directory and everything in it when it goes out of scope,
+    // so every way out of main() cleans up the dataset
+    class remove_on_exit {
+    public:
+        remove_on_exit(const string& dir) : _dir(dir) {}
+        ~remove_on_exit()
+        {
+            string command = "rm -rf " + _dir;
+            if (system(command.c_str()) != 0) {
+                cerr << "unable to remove " << _dir << endl;
+            }
+        }
+
+    private:
+        string _dir;
+    };
+
+    // random noise compresses badly, so the JPEGs are about as large as
+    // real photos of the same size
+    void write_dataset(const string& dir)
+    {
+        cv::theRNG().state = 0;
+        ofstream manifest(dir + "/manifest.csv");
+        for (int i = 0; i < item_count; i++) {
+            string image = dir + "/" + to_string(i) + ".jpg";
+            string label = dir + "/" + to_string(i) + ".txt";
+            cv::Mat mat(image_size, image_size, CV_8UC3);
+            cv::randu(mat, cv::Scalar::all(0), cv::Scalar::all(255));
+            cv::imwrite(image, mat);
+            ofstream(label) << i % 1000;
+            manifest << image << "," << label << "\n";
+        }
+    }
+
+    // A pipeline is started by start() and stopped by stop().  next() hands
+    // back the next minibatch and releases the previous one.
+    struct pipeline {
+        function<void()> start;
+        function<void()> next;
+        function<void()> stop;
+        function<nlohmann::json()> stats = []() { return nlohmann::json(); };
+    };
+
+    pipeline full_pipeline(const nlohmann::json& config)
+    {
+        auto l     = make_shared<loader>(config.dump());
+        auto first = make_shared<bool>(true);
+        pipeline p;
+        p.start = [l]() { l->start(); };
+        p.next  = [l, first]() {
+            if (*first == false) {
+                l->release();
+            }
+            *first = false;
+            l->next();
+        };
+        p.stop  = [l]() { l->stop(); };
+        p.stats = [l]() { return nlohmann::json::parse(l->stats()); };
+        return p;
+    }
+
+    pipeline io_pipeline(const loader_config& lcfg)
+    {
+        auto block_iter = make_shared<block_iterator_sequential>(loader::make_block_loader(lcfg));
+        auto batch_iter = make_shared<batch_iterator>(block_iter, lcfg.minibatch_size);
+        auto in         = make_shared<buffer_pool_in>(2, lcfg.read_buffer_depth);
+        auto reader     = make_shared<read_thread_pool>(in, batch_iter);
+        auto first      = make_shared<bool>(true);
+        pipeline p;
+        p.start = [reader]() { reader->start(); };
+        p.next  = [in, first]() {
+            if (*first == false) {
+                in->advance_read_pos();
+            }
+            *first = false;
+            if (in->wait_for_not_empty() == false) {
+                throw runtime_error("pipeline has been stopped");
+            }
+            in->reraise_exception();
+        };
+        p.stop  = [in, reader]() {
+            in->shutdown();
+            reader->stop();
+            reader->join();
+        };
+        return p;
+    }
+
+    pipeline decode_pipeline(const nlohmann::json& config, const loader_config& lcfg)
+    {
+        cerr << "loading " << item_count << " items into memory" << endl;
+        auto memory     = make_shared<block_loader_memory>(loader::make_block_loader(lcfg));
+        auto block_iter = make_shared<block_iterator_sequential>(memory);
+        auto batch_iter = make_shared<batch_iterator>(block_iter, lcfg.minibatch_size);
+
+        int  nthreads   = decode_threads > 0 ? decode_threads : decode_executor::available_cpus();
+        auto executor   = decode_executor::get(nthreads);
+        vector<shared_ptr<provider_interface>> providers;
+        for (int i = 0; i < executor->thread_count(); i++) {
+            providers.push_back(provider_factory::create(config));
+        }
+
+        const vector<shape_type>& oshapes = providers[0]->get_oshapes();
+        vector<size_t> write_sizes;
+        for (auto& o : oshapes) {
+            write_sizes.push_back(o.get_byte_size());
+        }
+
+        auto in      = make_shared<buffer_pool_in>(providers[0]->num_inputs, lcfg.read_buffer_depth);
+        auto out     = make_shared<buffer_pool_out>(write_sizes, (size_t)lcfg.minibatch_size, false);
+        auto reader  = make_shared<read_thread_pool>(in, batch_iter);
+        auto decoder = make_shared<decode_thread_pool>(executor, in, out, lcfg.minibatch_size, 1,
+                                                       std::min({nthreads,
+                                                                 executor->thread_count(),
+                                                                 lcfg.minibatch_size}));
+        for (auto& prov : providers) {
+            decoder->add_provider(prov);
+        }
+
+        auto first = make_shared<bool>(true);
+        pipeline p;
+        p.start = [reader, decoder]() {
+            decoder->start();
+            reader->start();
+        };
+        p.next  = [out, first]() {
+            if (*first == false) {
+                out->advance_read_pos();
+            }
+            *first = false;
+            if (out->wait_for_not_empty() == false) {
+                throw runtime_error("pipeline has been stopped");
+            }
+            out->reraise_exception();
+        };
+        p.stop  = [in, out, reader, decoder]() {
+            in->shutdown();
+            out->shutdown();
+            reader->stop();
+            decoder->stop();
+            reader->join();
+        };
+        return p;
+    }
+
+    double seconds_since(const chrono::steady_clock::time_point& start)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    nlohmann::json run(pipeline& p)
+    {
+        nlohmann::json js;
+        auto start = chrono::steady_clock::now();
+        p.start();
+        p.next();
+        js["time_to_first_batch_ms"] = seconds_since(start) * 1e3;
+
+        auto consume = []() {
+            if (consume_us > 0) {
+                this_thread::sleep_for(chrono::microseconds(consume_us));
+            }
+        };
+        for (int i = 0; i < warmup_batches; i++) {
+            consume();
+            p.next();
+        }
+
+        // only the time spent waiting in next() counts as latency, the
+        // consumer's own time is part of the throughput
+        vector<double> latency_us;
+        auto steady_start = chrono::steady_clock::now();
+        for (int i = 0; i < batches; i++) {
+            consume();
+            auto call_start = chrono::steady_clock::now();
+            p.next();
+            latency_us.push_back(seconds_since(call_start) * 1e6);
+            if ((i + 1) % 100 == 0) {
+                cerr << (i + 1) << "/" << batches << " minibatches" << endl;
+            }
+        }
+        double elapsed = seconds_since(steady_start);
+        js["stats"] = p.stats();
+        p.stop();
+
+        sort(latency_us.begin(), latency_us.end());
+        auto percentile = [&](double q) {
+            size_t index = std::min(latency_us.size() - 1, (size_t)(q * latency_us.size()));
+            return latency_us[index];
+        };
+        js["items_per_sec"]             = (double)batches * minibatch_size / elapsed;
+        js["minibatches_per_sec"]       = batches / elapsed;
+        js["next_latency_us"]["mean"]   = accumulate(latency_us.begin(), latency_us.end(), 0.0) / batches;
+        js["next_latency_us"]["p50"]    = percentile(0.5);
+        js["next_latency_us"]["p99"]    = percentile(0.99);
+        js["next_latency_us"]["p99.9"]  = percentile(0.999);
+        js["next_latency_us"]["max"]    = latency_us.back();
+        return js;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    string output;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:n:s:b:i:w:c:t:o:")) != -1) {
+        switch (opt) {
+        case 'm': mode           = optarg; break;
+        case 'n': item_count     = max(1, atoi(optarg)); break;
+        case 's': image_size     = max(1, atoi(optarg)); break;
+        case 'b': minibatch_size = max(1, atoi(optarg)); break;
+        case 'i': batches        = max(1, atoi(optarg)); break;
+        case 'w': warmup_batches = max(0, atoi(optarg)); break;
+        case 'c': consume_us     = max(0, atoi(optarg)); break;
+        case 't': decode_threads = max(0, atoi(optarg)); break;
+        case 'o': output         = optarg; break;
+        default:
+            cerr << "usage: " << argv[0] << " [-m full|io|decode] [-n items] [-s image_size]"
+                 << " [-b minibatch_size] [-i batches] [-w warmup_batches] [-c consume_us]"
+                 << " [-t decode_threads] [-o output]" << endl;
+            return 1;
+        }
+    }
+    if (mode != "full" && mode != "io" && mode != "decode") {
+        cerr << "unknown mode " << mode << ", expected full, io or decode" << endl;
+        return 1;
+    }
+
+    char dir[] = "/tmp/aeon_bench_XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        cerr << "unable to create a temporary directory" << endl;
+        return 1;
+    }
+    remove_on_exit cleanup(dir);
+
+    nlohmann::json result;
+    try {
+        cerr << "writing " << item_count << " images to " << dir << endl;
+        write_dataset(dir);
+        string cache_dir = string(dir) + "/cache";
+        mkdir(cache_dir.c_str(), 0755);
+
+        nlohmann::json config = {
+            {"type", "image,label"},
+            {"manifest_filename", string(dir) + "/manifest.csv"},
+            {"minibatch_size", minibatch_size},
+            {"macrobatch_size", 1024},
+            {"cache_directory", cache_dir},
+            {"decode_thread_count", decode_threads},
+            {"image", {{"height", 224}, {"width", 224}, {"flip_enable", true}}},
+            {"label", {{"binary", false}}}
+        };
+        loader_config lcfg(config);
+
+        // fill the cache, so that every mode reads from it
+        cerr << "priming the cache" << endl;
+        auto done = cache_warmer(config.dump()).run(0);
+        if (done.blocks_failed > 0) {
+            cerr << "unable to prime the cache: " << done.str() << endl;
+            return 1;
+        }
+
+        pipeline p = mode == "full" ? full_pipeline(config)
+                   : mode == "io"   ? io_pipeline(lcfg)
+                   :                  decode_pipeline(config, lcfg);
+        result = run(p);
+    } catch (exception& e) {
+        cerr << "benchmark failed: " << e.what() << endl;
+        return 1;
+    }
+
+    nlohmann::json js;
+    js["context"]["date"]           = (uint64_t)time(nullptr);
+    js["context"]["mode"]           = mode;
+    js["context"]["items"]          = item_count;
+    js["context"]["image_size"]     = image_size;
+    js["context"]["minibatch_size"] = minibatch_size;
+    js["context"]["batches"]        = batches;
+    js["context"]["warmup_batches"] = warmup_batches;
+    js["context"]["consume_us"]     = consume_us;
+    js["context"]["decode_threads"] = decode_threads;
+    js["result"]                    = result;
+    if (output.empty()) {
+        cout << js.dump(4) << endl;
+    } else {
+        ofstream(output) << js.dump(4) << endl;
+    }
+    return 0;
+}
@@ -31,7 +31,8 @@ TEST(buffer, shuffle) {
     // that they are sorted, then shuffle, then assert that they are
     // not sorted
 
-    buffer_in b;
+    buffer_in_array a(1);
+    buffer_in& b = *a[0];
 
     read(b, "abc");
     read(b, "asd");
@@ -44,11 +45,45 @@ TEST(buffer, shuffle) {
 
     ASSERT_EQ(sorted(buffer_to_vector_of_strings(b)), true);
 
-    b.shuffle(0);
+    a.shuffle(0);
 
     ASSERT_EQ(sorted(buffer_to_vector_of_strings(b)), false);
 }
 
+TEST(buffer, shuffle_records) {
+    // every buffer is read in the same order, and exceptions move with
+    // their record
+    buffer_in_array a(2);
+    for (int i = 0; i < 20; i++) {
+        string word = to_string(i);
+        read(*a[0], word.c_str());
+        if (i == 7) {
+            try {
+                throw std::runtime_error("expect me");
+            } catch (std::exception& e) {
+                a[1]->add_exception(std::current_exception());
+            }
+        } else {
+            read(*a[1], word.c_str());
+        }
+    }
+
+    a.shuffle(0);
+
+    int exceptions = 0;
+    for (int i = 0; i < 20; i++) {
+        item_span datum = a[0]->get_item(i);
+        try {
+            item_span target = a[1]->get_item(i);
+            ASSERT_EQ(string(datum.data(), datum.size()), string(target.data(), target.size()));
+        } catch (std::exception& e) {
+            ASSERT_EQ("7", string(datum.data(), datum.size()));
+            exceptions++;
+        }
+    }
+    ASSERT_EQ(1, exceptions);
+}
+
 void setup_buffer_exception(buffer_in& b) {
     // setup b with length 4, one value is an exception
     read(b, "a");
@@ -87,3 +122,78 @@ TEST(buffer, read_exception) {
         ASSERT_STREQ("expect me", e.what());
     }
 }
+
+TEST(buffer, reset) {
+    buffer_in b;
+
+    setup_buffer_exception(b);
+    b.reset();
+    ASSERT_EQ(0, b.get_item_count());
+
+    // the arena is reused, and exceptions from before the reset are gone
+    read(b, "e");
+    read(b, "f");
+    ASSERT_EQ(2, b.get_item_count());
+    ASSERT_EQ('e', b.get_item(0)[0]);
+    ASSERT_EQ('f', b.get_item(1)[0]);
+}
+
+TEST(buffer, grow) {
+    // items stay intact when the arena grows under them
+    buffer_in b;
+    vector<string> words;
+    for (int i = 0; i < 1000; i++) {
+        words.push_back(string(i, 'a' + i % 26));
+        b.add_item(vector<char>(words.back().begin(), words.back().end()));
+    }
+
+    ASSERT_EQ(words, buffer_to_vector_of_strings(b));
+}
+
+TEST(buffer, share_item) {
+    buffer_in block;
+    read(block, "abc");
+    read(block, "def");
+
+    buffer_in minibatch;
+    minibatch.share_item(block, 1);
+    minibatch.share_item(block, 0);
+    ASSERT_EQ(block.get_item(1).data(), minibatch.get_item(0).data());
+
+    // the block must not reuse memory the minibatch still refers to
+    block.reset();
+    read(block, "xyz");
+    read(block, "uvw");
+    ASSERT_EQ((vector<string>{"def", "abc"}), buffer_to_vector_of_strings(minibatch));
+
+    // exceptions are shared as exceptions
+    try {
+        throw std::runtime_error("expect me");
+    } catch (std::exception& e) {
+        block.add_exception(std::current_exception());
+    }
+    ASSERT_THROW(minibatch.share_item(block, 2), std::runtime_error);
+}
+
+TEST(buffer, add_view) {
+    char* bytes = new char[6];
+    memcpy(bytes, "abcdef", 6);
+    bool freed = false;
+    shared_ptr<void> memory(bytes, [&freed](void* p) { delete[] static_cast<char*>(p); freed = true; });
+
+    buffer_in block;
+    block.add_view(memory, bytes, 3);
+    block.add_view(memory, bytes + 3, 3);
+    ASSERT_EQ(bytes + 3, block.get_item(1).data());
+
+    buffer_in minibatch;
+    minibatch.share_item(block, 1);
+    memory = nullptr;
+    block.reset();
+
+    // the memory lives as long as any buffer holds one of its items
+    ASSERT_FALSE(freed);
+    ASSERT_EQ((vector<string>{"def"}), buffer_to_vector_of_strings(minibatch));
+    minibatch.reset();
+    ASSERT_TRUE(freed);
+}
@@ -0,0 +1,98 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "helpers.hpp"
+#include "block_iterator_async.hpp"
+#include "block_iterator_sequential.hpp"
+#include "block_iterator_shuffled.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    class block_loader_counting : public block_loader_alphabet {
+    public:
+        block_loader_counting(uint32_t block_size) : block_loader_alphabet(block_size) {}
+        void loadBlock(buffer_in_array& dest, uint32_t block_num)
+        {
+            block_loader_alphabet::loadBlock(dest, block_num);
+            loads++;
+        }
+        atomic<int> loads{0};
+    };
+
+    // reads the next block the way batch_iterator does
+    vector<string> read_words(block_iterator& it, buffer_in_array& bp)
+    {
+        for (auto b : bp) {
+            b->reset();
+        }
+        it.read(bp);
+        return buffer_to_vector_of_strings(*bp[0]);
+    }
+}
+
+TEST(block_iterator_async, same_order) {
+    // read ahead must not change which blocks come out or their shuffle
+    block_iterator_shuffled expected(make_shared<block_loader_alphabet>(4));
+    block_iterator_async    async(make_shared<block_iterator_shuffled>(make_shared<block_loader_alphabet>(4)), 1);
+
+    buffer_in_array a(2);
+    buffer_in_array b(2);
+    for (int i = 0; i < 2 * 26; i++) {
+        vector<string> words = read_words(async, a);
+        ASSERT_EQ(read_words(expected, b), words);
+        ASSERT_EQ(words, buffer_to_vector_of_strings(*a[1]));
+    }
+}
+
+TEST(block_iterator_async, loads_next_block_ahead) {
+    auto mbl = make_shared<block_loader_counting>(4);
+    block_iterator_async async(make_shared<block_iterator_sequential>(mbl), 1);
+
+    buffer_in_array bp(1);
+    read_words(async, bp);
+
+    // the next block is loaded as soon as this one is handed out, without
+    // waiting for the next read, and no further than that
+    for (int i = 0; i < 500 && mbl->loads < 2; i++) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    ASSERT_EQ(2, mbl->loads);
+    this_thread::sleep_for(chrono::milliseconds(50));
+    ASSERT_EQ(2, mbl->loads);
+
+    ASSERT_EQ("Ba", read_words(async, bp)[0]);
+}
+
+TEST(block_iterator_async, reset) {
+    block_iterator_async async(make_shared<block_iterator_sequential>(make_shared<block_loader_alphabet>(4)), 2);
+
+    buffer_in_array bp(1);
+    for (int i = 0; i < 3; i++) {
+        read_words(async, bp);
+    }
+
+    // blocks read ahead before the reset are thrown away
+    async.reset();
+    ASSERT_EQ("Aa", read_words(async, bp)[0]);
+    ASSERT_EQ("Ba", read_words(async, bp)[0]);
+}
@@ -0,0 +1,213 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+
+#include "helpers.hpp"
+#include "block_iterator_shuffle_buffer.hpp"
+#include "block_iterator_sequential.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// where an alphabet record such as "Cb" comes in the sequential stream
+static int stream_position(const string& word, int block_size) {
+    return (word[0] - 'A') * block_size + (word[1] - 'a');
+}
+
+namespace {
+    // remembers every block buffer the source was read into
+    class block_iterator_recording : public block_iterator {
+    public:
+        block_iterator_recording(shared_ptr<block_iterator> src) : _src(src) {}
+        void read(buffer_in_array& dest)
+        {
+            buffers.insert(&dest);
+            _src->read(dest);
+        }
+        void reset() { _src->reset(); }
+
+        set<buffer_in_array*> buffers;
+    private:
+        shared_ptr<block_iterator> _src;
+    };
+
+    // reads the block from its source and then throws on the reads listed
+    class block_iterator_failing : public block_iterator {
+    public:
+        block_iterator_failing(shared_ptr<block_iterator> src, set<int> failures)
+        : _src(src), _failures(failures) {}
+        void read(buffer_in_array& dest)
+        {
+            _src->read(dest);
+            if (_failures.count(++_reads) > 0) {
+                throw runtime_error("read failed");
+            }
+        }
+        void reset() { _src->reset(); }
+
+    private:
+        shared_ptr<block_iterator> _src;
+        set<int>                   _failures;
+        int                        _reads = 0;
+    };
+
+    vector<string> read_words(block_iterator& it)
+    {
+        buffer_in_array bp(1);
+        it.read(bp);
+        return buffer_to_vector_of_strings(*bp[0]);
+    }
+}
+
+TEST(block_iterator_shuffle_buffer, shuffles_across_blocks) {
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto seq = make_shared<block_iterator_sequential>(mbl);
+    block_iterator_shuffle_buffer sb(seq, mbl->blockCount(), 20, 10);
+
+    vector<string> words_a;
+    vector<string> words_b;
+    for (int i = 0; i < 10; i++) {
+        buffer_in_array bp(2);
+        sb.read(bp);
+        ASSERT_EQ(10, bp[0]->get_item_count());
+        for (auto& w : buffer_to_vector_of_strings(*bp[0])) {
+            words_a.push_back(w);
+        }
+        for (auto& w : buffer_to_vector_of_strings(*bp[1])) {
+            words_b.push_back(w);
+        }
+    }
+
+    // the components of each record stay together
+    ASSERT_EQ(words_a, words_b);
+
+    // a record can't be returned before it has been read into the pool
+    set<int> blocks;
+    for (size_t i = 0; i < words_a.size(); i++) {
+        ASSERT_LT(stream_position(words_a[i], 5), i + 20);
+        if (i < 10) {
+            blocks.insert(words_a[i][0]);
+        }
+    }
+
+    // the first block returned mixes records from several source blocks
+    ASSERT_GT(blocks.size(), 2);
+
+    ASSERT_EQ(sorted(words_a), false);
+    assert_vector_unique(words_a);
+}
+
+TEST(block_iterator_shuffle_buffer, reset) {
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto seq = make_shared<block_iterator_sequential>(mbl);
+    block_iterator_shuffle_buffer sb(seq, mbl->blockCount(), 8, 4);
+
+    buffer_in_array bp(1);
+    for (int i = 0; i < 10; i++) {
+        for (auto b : bp) {
+            b->reset();
+        }
+        sb.read(bp);
+    }
+
+    // after a reset the pool is refilled from the start of the source, and
+    // topped up by one record before each of the 3 draws after the first
+    sb.reset();
+    for (auto b : bp) {
+        b->reset();
+    }
+    sb.read(bp);
+    for (auto& w : buffer_to_vector_of_strings(*bp[0])) {
+        ASSERT_LT(stream_position(w, 5), 8 + 3);
+    }
+}
+
+TEST(block_iterator_shuffle_buffer, memory) {
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto src = make_shared<block_iterator_recording>(make_shared<block_iterator_sequential>(mbl));
+    block_iterator_shuffle_buffer sb(src, mbl->blockCount(), 20, 10);
+
+    buffer_in_array first(2);
+    sb.read(first);
+    vector<string> words = buffer_to_vector_of_strings(*first[0]);
+
+    for (int i = 0; i < 30; i++) {
+        buffer_in_array bp(2);
+        sb.read(bp);
+    }
+
+    // records are copied into the pool, so a single block buffer is read
+    // into however long records stay in the pool
+    ASSERT_EQ(1, src->buffers.size());
+
+    // and a returned block doesn't depend on the source buffers
+    ASSERT_EQ(words, buffer_to_vector_of_strings(*first[0]));
+}
+
+TEST(block_iterator_shuffle_buffer, epoch) {
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto seq = make_shared<block_iterator_sequential>(mbl);
+    block_iterator_shuffle_buffer sb(seq, mbl->blockCount(), 40, 10);
+
+    // blocks straddle the end of a pass, but each pass returns every record
+    // once before any record of the next
+    vector<string> words;
+    while (words.size() < 3 * 130) {
+        for (auto& w : read_words(sb)) {
+            words.push_back(w);
+        }
+    }
+    for (int pass = 0; pass < 3; pass++) {
+        vector<string> epoch(words.begin() + pass * 130, words.begin() + (pass + 1) * 130);
+        sort(epoch.begin(), epoch.end());
+        assert_vector_unique(epoch);
+        ASSERT_EQ("Aa", epoch.front());
+        ASSERT_EQ("Ze", epoch.back());
+    }
+}
+
+TEST(block_iterator_shuffle_buffer, source_throws) {
+    auto mbl = make_shared<block_loader_alphabet>(5);
+    auto seq = make_shared<block_iterator_sequential>(mbl);
+    // the second read fails while the pool is first filled, the fifth while
+    // a record drawn is being replaced
+    auto src = make_shared<block_iterator_failing>(seq, set<int>{2, 5});
+    block_iterator_shuffle_buffer sb(src, mbl->blockCount(), 8, 4);
+
+    vector<string> words;
+    int            failures = 0;
+    while (words.size() < 100) {
+        try {
+            for (auto& w : read_words(sb)) {
+                words.push_back(w);
+            }
+        } catch (std::exception&) {
+            failures++;
+        }
+    }
+    ASSERT_EQ(2, failures);
+
+    // no record is returned twice, and the failed blocks are skipped
+    assert_vector_unique(words);
+    for (auto& w : words) {
+        ASSERT_NE('B', w[0]);
+        ASSERT_NE('E', w[0]);
+    }
+}
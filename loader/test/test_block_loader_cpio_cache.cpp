@@ -13,10 +13,15 @@
  limitations under the License.
 */
 
+#include <atomic>
 #include <random>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "gtest/gtest.h"
 #include "block_loader_cpio_cache.hpp"
+#include "cache_index.hpp"
+#include "telemetry.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -27,7 +32,7 @@ string load_string(block_loader_cpio_cache cache) {
 
     cache.loadBlock(bp, 1);
 
-    vector<char>& x = bp[0]->get_item(0);
+    item_span x = bp[0]->get_item(0);
     string str(x.data(), x.size());
     return str;
 }
@@ -41,6 +46,23 @@ block_loader_cpio_cache make_cache(const string& rootCacheDir,
     return cache;
 }
 
+namespace {
+    class block_loader_counting : public block_loader_random {
+    public:
+        block_loader_counting() : block_loader_random(1) {}
+        void loadBlock(buffer_in_array& dest, uint32_t block_num)
+        {
+            block_loader_random::loadBlock(dest, block_num);
+            loads++;
+        }
+        atomic<int> loads{0};
+    };
+
+    bool cached(const string& hash, const string& version) {
+        return access(("/tmp/" + hash + "_" + version + "/1-1.cpio").c_str(), F_OK) == 0;
+    }
+}
+
 TEST(block_loader_cpio_cache, integration) {
     // load the same block twice and make sure it has the same value.
     // block_loader_random always returns a different uint32_t value no matter
@@ -74,3 +96,80 @@ TEST(block_loader_cpio_cache, differnt_hash) {
         load_string(make_cache("/tmp", block_loader_random::randomString(), "version123"))
     );
 }
+
+TEST(block_loader_cpio_cache, write_in_background) {
+    string hash = block_loader_random::randomString();
+    auto loader = make_shared<block_loader_counting>();
+    string first;
+    {
+        block_loader_cpio_cache cache("/tmp", hash, "version123", loader);
+        first = load_string(cache);
+        // from the write queue or the cache, whichever has it by now
+        ASSERT_EQ(first, load_string(cache));
+    }
+
+    // everything queued is written by the time the cache is gone
+    ASSERT_TRUE(cached(hash, "version123"));
+    ASSERT_EQ(first, load_string(make_cache("/tmp", hash, "version123")));
+    ASSERT_EQ(1, loader->loads);
+}
+
+TEST(block_loader_cpio_cache, write_depth_0) {
+    string hash = block_loader_random::randomString();
+    block_loader_cpio_cache cache("/tmp", hash, "version123", make_shared<block_loader_random>(1), 0);
+
+    buffer_in_array bp(2);
+    cache.loadBlock(bp, 1);
+    ASSERT_TRUE(cached(hash, "version123"));
+}
+
+TEST(block_loader_cpio_cache, size_limit) {
+    char root[] = "/tmp/aeon_cache_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(root));
+    auto loader = make_shared<block_loader_alphabet>(1);
+    telemetry t;
+    telemetry::scope scope(&t);
+
+    // a block cached before there was a budget
+    block_loader_cpio_cache unlimited(root, "dataset_a", "v1", loader, 0);
+    buffer_in_array first(2);
+    unlimited.loadBlock(first, 0);
+    struct stat stats;
+    ASSERT_EQ(0, stat(unlimited.blockFilename(0).c_str(), &stats));
+    uint64_t limit = 3 * stats.st_size;
+
+    {
+        block_loader_cpio_cache a(root, "dataset_a", "v1", loader, 0, limit);
+        for (uint32_t block_num : {1, 2, 0}) {
+            buffer_in_array bp(2);
+            a.loadBlock(bp, block_num);
+        }
+        EXPECT_EQ(0, t.cache_evictions);
+        EXPECT_EQ(limit, cache_index(root, limit).size());
+
+        // the read of block 0 is merged into the index when block 3 is
+        // added, so block 1 goes
+        buffer_in_array third(2);
+        a.loadBlock(third, 3);
+        EXPECT_EQ(1, t.cache_evictions);
+        EXPECT_FALSE(a.isCached(1));
+
+        // this read only reaches the index when `a` is destroyed
+        buffer_in_array again(2);
+        a.loadBlock(again, 2);
+    }
+
+    // another dataset in the same directory pushes out the block of the
+    // first one which was used least recently
+    block_loader_cpio_cache b(root, "dataset_b", "v1", loader, 0, limit);
+    buffer_in_array bp(2);
+    b.loadBlock(bp, 0);
+    EXPECT_EQ(2, t.cache_evictions);
+    block_loader_cpio_cache a(root, "dataset_a", "v1", loader, 0);
+    EXPECT_FALSE(a.isCached(0));
+    EXPECT_FALSE(a.isCached(1));
+    EXPECT_TRUE(a.isCached(2));
+    EXPECT_TRUE(a.isCached(3));
+    EXPECT_TRUE(b.isCached(0));
+    EXPECT_EQ(limit, cache_index(root, limit).size());
+}
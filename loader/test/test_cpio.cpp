@@ -17,10 +17,14 @@
 #include <string>
 #include <sstream>
 #include <random>
+#include <fstream>
+#include <unistd.h>
+#include <utime.h>
 
 #include "gtest/gtest.h"
 #include "cpio.hpp"
 #include "buffer_in.hpp"
+#include "csv_manifest_maker.hpp"
 
 #define private public
 
@@ -39,3 +43,162 @@ TEST(cpio, read_nds)
     reader.read(buffer);
     EXPECT_EQ(1, buffer.get_item_count());
 }
+
+namespace {
+    // ten records of a datum and a target, of odd sizes so that records are padded
+    void make_records(buffer_in_array& records)
+    {
+        for (int i = 0; i < 10; i++) {
+            records[0]->add_item(vector<char>(2 * i + 1, 'a' + i));
+            records[1]->add_item(vector<char>(i, 'A' + i));
+        }
+    }
+
+    string write_records(buffer_in_array& records, bool index)
+    {
+        string filename = tmp_filename();
+        cpio::file_writer writer;
+        writer.open(filename, "", index);
+        writer.write_all_records(records);
+        writer.close();
+        return filename;
+    }
+
+    string item_string(buffer_in& b, int i)
+    {
+        item_span item = b.get_item(i);
+        return string(item.data(), item.size());
+    }
+}
+
+TEST(cpio, mmap_reader)
+{
+    buffer_in_array records(2);
+    make_records(records);
+    string filename = write_records(records, false);
+
+    buffer_in_array mapped(2);
+    {
+        cpio::mmap_reader reader;
+        ASSERT_TRUE(reader.open(filename));
+        ASSERT_EQ(10, reader.itemCount());
+        for (int i = 0; i < reader.itemCount(); i++) {
+            reader.read(*mapped[0]);
+            reader.read(*mapped[1]);
+        }
+    }
+
+    // the items stay valid after the reader is gone
+    for (int b = 0; b < 2; b++) {
+        ASSERT_EQ(records[b]->get_item_count(), mapped[b]->get_item_count());
+        for (int i = 0; i < records[b]->get_item_count(); i++) {
+            ASSERT_EQ(item_string(*records[b], i), item_string(*mapped[b], i));
+        }
+    }
+
+    cpio::mmap_reader reader;
+    EXPECT_FALSE(reader.open(filename + ".missing"));
+}
+
+TEST(cpio, read_record)
+{
+    buffer_in_array records(2);
+    make_records(records);
+    string filename = write_records(records, true);
+
+    cpio::file_reader reader;
+    ASSERT_TRUE(reader.open(filename));
+    cpio::mmap_reader mapped;
+    ASSERT_TRUE(mapped.open(filename));
+
+    buffer_in_array a(2);
+    buffer_in_array b(2);
+    for (int i = 9; i >= 0; i--) {
+        reader.read_record(i, a);
+        mapped.read_record(i, b);
+    }
+    for (int i = 0; i < 10; i++) {
+        for (int e = 0; e < 2; e++) {
+            ASSERT_EQ(item_string(*records[e], 9 - i), item_string(*a[e], i));
+            ASSERT_EQ(item_string(*records[e], 9 - i), item_string(*b[e], i));
+        }
+    }
+
+    // sequential reads carry on from where they were
+    buffer_in datum;
+    reader.read(datum);
+    ASSERT_EQ(item_string(*records[0], 0), item_string(datum, 0));
+
+    EXPECT_THROW(reader.read_record(10, a), std::invalid_argument);
+    buffer_in_array one(1);
+    EXPECT_THROW(mapped.read_record(0, one), std::invalid_argument);
+
+    // the index is optional
+    cpio::mmap_reader unindexed;
+    ASSERT_TRUE(unindexed.open(write_records(records, false)));
+    EXPECT_THROW(unindexed.read_record(0, b), std::runtime_error);
+}
+
+TEST(cpio, large_records)
+{
+    // items too large to stage are written straight from the buffer in, in
+    // the same writev as the small ones staged before them
+    buffer_in_array records(2);
+    for (int i = 0; i < 3; i++) {
+        records[0]->add_item(vector<char>(10, 'a' + i));
+        records[1]->add_item(vector<char>(200 * 1024 + i, 'A' + i));
+    }
+    string filename = write_records(records, true);
+
+    cpio::file_reader reader;
+    ASSERT_TRUE(reader.open(filename));
+    buffer_in_array read(2);
+    for (int i = 0; i < 3; i++) {
+        reader.read_record(i, read);
+        ASSERT_EQ(item_string(*records[0], i), item_string(*read[0], i));
+        ASSERT_EQ(item_string(*records[1], i), item_string(*read[1], i));
+    }
+}
+
+TEST(cpio, concurrent_writers)
+{
+    char dir[] = "/tmp/aeon_cpio_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    string filename = string(dir) + "/0-10.cpio";
+
+    buffer_in_array a(2);
+    make_records(a);
+    buffer_in_array b(2);
+    for (int i = 0; i < 3; i++) {
+        b[0]->add_item(vector<char>(100, 'x'));
+        b[1]->add_item(vector<char>(1, 'y'));
+    }
+
+    // two writers of one block, e.g. in two processes sharing a cache, each
+    // build their own file and the last one closed wins
+    cpio::file_writer first;
+    cpio::file_writer second;
+    first.open(filename, "", true);
+    second.open(filename, "", true);
+    first.write_all_records(a);
+    second.write_all_records(b);
+    first.close();
+    second.close();
+
+    cpio::file_reader reader;
+    ASSERT_TRUE(reader.open(filename));
+    ASSERT_EQ(3, reader.itemCount());
+    buffer_in_array read(2);
+    reader.read_record(2, read);
+    ASSERT_EQ(string(100, 'x'), item_string(*read[0], 0));
+
+    // an abandoned temporary file is only removed once it is old
+    string stale = filename + ".abcdef.tmp";
+    ofstream(stale) << "partial";
+    cpio::file_writer::remove_stale_temp_files(dir);
+    ASSERT_EQ(0, access(stale.c_str(), F_OK));
+    struct utimbuf old = {time(nullptr) - 7200, time(nullptr) - 7200};
+    ASSERT_EQ(0, utime(stale.c_str(), &old));
+    cpio::file_writer::remove_stale_temp_files(dir);
+    ASSERT_NE(0, access(stale.c_str(), F_OK));
+}
@@ -0,0 +1,51 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cpu_affinity.hpp"
+
+using namespace std;
+using namespace nervana;
+
+TEST(cpu_affinity, parse_cpu_list) {
+    EXPECT_EQ(vector<int>({0, 1, 2, 3, 8}), cpu_affinity::parse_cpu_list("0-3,8"));
+    EXPECT_TRUE(cpu_affinity::parse_cpu_list("3-1").empty());
+    EXPECT_TRUE(cpu_affinity::parse_cpu_list("abc").empty());
+
+    // rejected without expanding the range
+    EXPECT_THROW(cpu_affinity::parse_cpu_list("0-2000000000"), std::invalid_argument);
+}
+
+TEST(cpu_affinity, cpu_list) {
+    vector<int> allowed = cpu_affinity::allowed_cpus();
+    cpu_affinity affinity(to_string(allowed[0]));
+    EXPECT_EQ(vector<int>({allowed[0]}), affinity.cpus());
+
+    EXPECT_THROW(cpu_affinity("x"), std::invalid_argument);
+
+    // cpus outside the process' mask are named
+    int unavailable = *max_element(allowed.begin(), allowed.end()) + 1;
+    try {
+        cpu_affinity(to_string(allowed[0]) + "," + to_string(unavailable));
+        FAIL() << "cpu " << unavailable << " accepted";
+    } catch (std::invalid_argument& e) {
+        EXPECT_NE(string::npos, string(e.what()).find("cpus " + to_string(unavailable) + " "));
+    }
+}
@@ -0,0 +1,454 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "loader.hpp"
+#include "cache_warmer.hpp"
+#include "csv_manifest_maker.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    // an image,label manifest of the test images, labelled 0 to count-1,
+    // except that item `bad_label` has a label which can't be parsed
+    string image_label_manifest(int count, int bad_label = -1)
+    {
+        string manifest = tmp_filename();
+        ofstream f(manifest);
+        for (int i = 0; i < count; i++) {
+            string label = tmp_filename();
+            if (i == bad_label) {
+                ofstream(label) << "not a label";
+            } else {
+                ofstream(label) << i;
+            }
+            f << CURDIR << (i % 2 ? "/test_data/flowers.jpg" : "/test_data/img_2112_70.jpg")
+              << "," << label << endl;
+        }
+        return manifest;
+    }
+
+    nlohmann::json image_label_config(const string& manifest)
+    {
+        return {
+            {"type", "image,label"},
+            {"manifest_filename", manifest},
+            {"minibatch_size", 4},
+            {"decode_thread_count", 2},
+            {"image", {{"height", 32}, {"width", 24}}},
+            {"label", {{"binary", false}}}
+        };
+    }
+
+    // a decode_executor client which always has work, and keeps track of
+    // how many chunks it ran and how many threads ran it at once
+    class busy_client : public decode_executor::client {
+    public:
+        bool has_work() override { return true; }
+
+        void run_chunk(int thread_id) override
+        {
+            int n    = ++running;
+            int most = most_running;
+            while (n > most && !most_running.compare_exchange_weak(most, n)) {
+            }
+            // spin rather than sleep, so that every chunk takes as long
+            auto start = chrono::steady_clock::now();
+            while (chrono::steady_clock::now() - start < chrono::microseconds(100)) {
+            }
+            chunks++;
+            running--;
+        }
+
+        atomic<int>         running{0};
+        atomic<int>         most_running{0};
+        atomic<uint64_t>    chunks{0};
+    };
+
+    // decodes an int32_t item as itself, taking longer over some items than
+    // others so that they finish out of order, and fails on a negative one
+    class int_provider : public provider_interface {
+    public:
+        int_provider()
+        {
+            num_inputs = 1;
+            oshapes.emplace_back(vector<size_t>{1}, output_type("int32_t"));
+        }
+
+        void provide(int idx, buffer_in_array& in, buffer_out_array& out) override
+        {
+            item_span item = in[0]->get_item(idx);
+            int32_t   value;
+            memcpy(&value, item.data(), sizeof(value));
+            if (value < 0) {
+                throw runtime_error("bad item");
+            }
+            this_thread::sleep_for(chrono::microseconds((value * 37) % 200));
+            memcpy(out[0]->get_item(idx), &value, sizeof(value));
+        }
+    };
+
+    // feeds `batches` minibatches of consecutive numbers through a
+    // decode_thread_pool on `executor`, with `depth` buffers on either side,
+    // and checks that they come out whole and in order.  Item `bad` fails,
+    // and its minibatch comes out as the exception instead.  The consumer
+    // only starts once `depth` minibatches have been read, so they are all
+    // in flight at once.
+    void decode_in_order(const shared_ptr<decode_executor>& executor,
+                         int batch_size, int depth, int batches, int bad = -1)
+    {
+        auto in  = make_shared<buffer_pool_in>(1, depth);
+        auto out = make_shared<buffer_pool_out>(vector<size_t>{sizeof(int32_t)}, batch_size, false, depth);
+        decode_thread_pool pool(executor, in, out, batch_size);
+        for (int i = 0; i < executor->thread_count(); i++) {
+            pool.add_provider(make_shared<int_provider>());
+        }
+        pool.start();
+
+        thread producer([&]() {
+            for (int b = 0; b < batches && in->wait_for_not_full(); b++) {
+                buffer_in_array& bufs = in->get_for_write();
+                bufs[0]->reset();
+                for (int i = 0; i < batch_size; i++) {
+                    int32_t value = b * batch_size + i == bad ? -1 : b * batch_size + i;
+                    bufs[0]->add_item(reinterpret_cast<const char*>(&value), sizeof(value));
+                }
+                in->advance_write_pos();
+            }
+        });
+
+        while (in->write_pos() < (uint64_t)std::min(depth, batches)) {
+            this_thread::yield();
+        }
+        for (int b = 0; b < batches && out->wait_for_not_empty(); b++) {
+            if (bad >= 0 && b == bad / batch_size) {
+                EXPECT_THROW(out->reraise_exception(), runtime_error);
+                out->advance_read_pos();
+                continue;
+            }
+            int32_t* values = reinterpret_cast<int32_t*>(out->get_for_read()[0]->data());
+            for (int i = 0; i < batch_size; i++) {
+                EXPECT_EQ(b * batch_size + i, values[i]);
+            }
+            out->advance_read_pos();
+        }
+
+        in->shutdown();
+        out->shutdown();
+        producer.join();
+        pool.stop();
+    }
+}
+
+TEST(loader, native) {
+    loader l(image_label_config(image_label_manifest(8)).dump());
+    ASSERT_EQ(8, l.itemCount());
+    ASSERT_EQ(0, l.start());
+
+    ASSERT_EQ(2, l.get_oshapes().size());
+    for (int epoch = 0; epoch < 2; epoch++) {
+        for (int b = 0; b < 2; b++) {
+            const minibatch& mb = l.next();
+            ASSERT_EQ(2, mb.size());
+            ASSERT_EQ(4, mb.batch_size());
+
+            EXPECT_EQ(vector<size_t>({3, 32, 24}), mb.shape(0).get_shape());
+            EXPECT_EQ("uint8_t", mb.shape(0).get_otype().tp_name);
+            EXPECT_EQ(4 * 3 * 32 * 24, mb.byte_size(0));
+            EXPECT_EQ("uint32_t", mb.shape(1).get_otype().tp_name);
+
+            uint32_t* labels = reinterpret_cast<uint32_t*>(mb.data(1));
+            for (int i = 0; i < 4; i++) {
+                EXPECT_EQ(b * 4 + i, labels[i]);
+            }
+
+            // the minibatch has to be handed back first
+            EXPECT_THROW(l.next(), std::runtime_error);
+            l.release();
+        }
+    }
+
+    // a minibatch still held is dropped by reset
+    l.next();
+    l.reset();
+    const minibatch& mb = l.next();
+    EXPECT_EQ(0, reinterpret_cast<uint32_t*>(mb.data(1))[0]);
+    l.release();
+    EXPECT_THROW(l.release(), std::runtime_error);
+
+    l.stop();
+}
+
+TEST(loader, device_buffer_count) {
+    auto config = image_label_config(image_label_manifest(8));
+    config["device_buffer_count"] = 0;
+    EXPECT_THROW(loader(config.dump()), std::invalid_argument);
+
+    // a deeper rotation keeps more minibatches decoded, in the same order
+    config["device_buffer_count"] = 3;
+    loader l(config.dump());
+    ASSERT_EQ(3, l.device_buffer_count());
+    ASSERT_EQ(0, l.start());
+    for (int b = 0; b < 6; b++) {
+        const minibatch& mb = l.next();
+        EXPECT_EQ((b % 2) * 4, reinterpret_cast<uint32_t*>(mb.data(1))[0]);
+        l.release();
+    }
+    l.stop();
+}
+
+TEST(loader, warm_cache) {
+    auto config = image_label_config(image_label_manifest(10));
+    EXPECT_THROW(cache_warmer(config.dump()), std::invalid_argument);
+
+    char cache_dir[] = "/tmp/aeon_cache_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(cache_dir));
+    config["cache_directory"] = cache_dir;
+    config["macrobatch_size"] = 4;
+
+    cache_warmer warmer(config.dump());
+    ASSERT_EQ(3, warmer.blockCount());
+    int reports = 0;
+    auto done = warmer.run(2, [&](const cache_warmer::progress&) { reports++; });
+    EXPECT_EQ(3, done.blocks_done);
+    EXPECT_EQ(0, done.blocks_skipped);
+    EXPECT_EQ(0, done.blocks_failed);
+    EXPECT_LT(0, done.bytes_written);
+    EXPECT_LE(1, reports);
+
+    // a second warm-up has nothing left to do
+    done = warmer.run(2);
+    EXPECT_EQ(3, done.blocks_skipped);
+    EXPECT_EQ(0, done.bytes_written);
+
+    // and the loader finds every block in the cache
+    loader l(config.dump());
+    ASSERT_EQ(0, l.start());
+    for (int b = 0; b < 2; b++) {
+        l.next();
+        l.release();
+    }
+    auto stats = nlohmann::json::parse(l.stats());
+    EXPECT_EQ(0, stats["read"]["cache_misses"].get<int>());
+    l.stop();
+}
+
+TEST(decode_executor, weight) {
+    // a single thread is shared between busy clients by weight
+    decode_executor executor(1);
+    busy_client light;
+    busy_client heavy;
+    executor.add_client(&light, 1, 1);
+    executor.add_client(&heavy, 3, 1);
+    this_thread::sleep_for(chrono::milliseconds(300));
+    double ratio = (double)heavy.chunks / light.chunks;
+    executor.remove_client(&light);
+    executor.remove_client(&heavy);
+
+    EXPECT_LT(2.0, ratio);
+    EXPECT_GT(4.5, ratio);
+}
+
+TEST(decode_executor, max_threads) {
+    decode_executor executor(4);
+    busy_client limited;
+    busy_client other;
+    executor.add_client(&limited, 1, 2);
+    executor.add_client(&other, 1, 4);
+    this_thread::sleep_for(chrono::milliseconds(100));
+    EXPECT_GE(2, limited.most_running);
+    EXPECT_LT(0, other.chunks);
+
+    // a lower limit applies once the chunks already running are done
+    executor.set_max_threads(&limited, 1);
+    this_thread::sleep_for(chrono::milliseconds(10));
+    limited.most_running = 0;
+    this_thread::sleep_for(chrono::milliseconds(100));
+    EXPECT_GE(1, limited.most_running);
+
+    // a client can leave while the others keep running, and once it has
+    // gone no thread is working for it
+    executor.remove_client(&limited);
+    EXPECT_EQ(0, limited.running);
+    uint64_t chunks = limited.chunks;
+    uint64_t before = other.chunks;
+    this_thread::sleep_for(chrono::milliseconds(50));
+    EXPECT_EQ(chunks, limited.chunks);
+    EXPECT_LT(before, other.chunks);
+    executor.remove_client(&other);
+}
+
+TEST(loader, shared_executor) {
+    // two loaders in one process decode on the same executor, with
+    // different weights and thread limits
+    string manifest = image_label_manifest(16);
+    auto   light_config = image_label_config(manifest);
+    auto   heavy_config = image_label_config(manifest);
+    heavy_config["decode_weight"]       = 4;
+    heavy_config["decode_thread_count"] = 1;
+    loader light(light_config.dump());
+    loader heavy(heavy_config.dump());
+    ASSERT_EQ(0, light.start());
+    ASSERT_EQ(0, heavy.start());
+    EXPECT_EQ(2, light.decode_thread_stats().size());
+    EXPECT_EQ(2, heavy.decode_thread_stats().size());
+
+    atomic<bool> light_stopped{false};
+    atomic<int>  heavy_batches{0};
+    atomic<int>  heavy_errors{0};
+    thread consumer([&]() {
+        for (int b = 0; b < 40; b++) {
+            if (b == 20) {
+                while (!light_stopped) {
+                    this_thread::yield();
+                }
+            }
+            const minibatch& mb = heavy.next();
+            uint32_t* labels = reinterpret_cast<uint32_t*>(mb.data(1));
+            for (int i = 0; i < 4; i++) {
+                if (labels[i] != (b % 4) * 4 + i) {
+                    heavy_errors++;
+                }
+            }
+            heavy.release();
+            heavy_batches++;
+        }
+    });
+
+    for (int b = 0; b < 8; b++) {
+        const minibatch& mb = light.next();
+        EXPECT_EQ((b % 4) * 4, reinterpret_cast<uint32_t*>(mb.data(1))[0]);
+        light.release();
+    }
+    // stopping one loader leaves the other one decoding
+    light.stop();
+    light_stopped = true;
+    consumer.join();
+    EXPECT_EQ(40, heavy_batches);
+    EXPECT_EQ(0, heavy_errors);
+    heavy.stop();
+}
+
+TEST(decode_thread_pool, more_threads_than_items) {
+    // threads with no item left to claim in the current minibatch move on
+    // to the next one
+    decode_in_order(make_shared<decode_executor>(4), 2, 2, 64);
+}
+
+TEST(decode_thread_pool, minibatches_in_flight) {
+    // more minibatches dispatched than threads, and a failed item which
+    // has to come out in its place
+    decode_in_order(make_shared<decode_executor>(2), 4, 8, 64, 4 * 37 + 1);
+}
+
+TEST(loader, decode_error) {
+    // an item which can't be decoded fails its minibatch, in order, and
+    // leaves the rest of the epoch alone
+    loader l(image_label_config(image_label_manifest(8, 5)).dump());
+    ASSERT_EQ(0, l.start());
+    for (int epoch = 0; epoch < 2; epoch++) {
+        const minibatch& mb = l.next();
+        EXPECT_EQ(0, reinterpret_cast<uint32_t*>(mb.data(1))[0]);
+        l.release();
+        EXPECT_THROW(l.next(), std::exception);
+    }
+    l.stop();
+}
+
+TEST(decode_executor, available_cpus) {
+    int  allowed = cpu_affinity::allowed_cpus().size();
+    char root[]  = "/tmp/aeon_cgroup_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(root));
+    string dir = root;
+
+    // without a CFS quota only the cpuset counts
+    EXPECT_EQ(allowed, decode_executor::available_cpus(dir));
+
+    // cgroup v1, in either of the usual places
+    ASSERT_EQ(0, mkdir((dir + "/cpu,cpuacct").c_str(), 0755));
+    ofstream(dir + "/cpu,cpuacct/cpu.cfs_quota_us") << "-1" << endl;
+    ofstream(dir + "/cpu,cpuacct/cpu.cfs_period_us") << "100000" << endl;
+    EXPECT_EQ(allowed, decode_executor::available_cpus(dir));
+    // part of a cpu still gets a thread
+    ofstream(dir + "/cpu,cpuacct/cpu.cfs_quota_us") << "50000" << endl;
+    EXPECT_EQ(1, decode_executor::available_cpus(dir));
+
+    ASSERT_EQ(0, mkdir((dir + "/cpu").c_str(), 0755));
+    ofstream(dir + "/cpu/cpu.cfs_quota_us") << "150000" << endl;
+    ofstream(dir + "/cpu/cpu.cfs_period_us") << "100000" << endl;
+    EXPECT_EQ(std::min(allowed, 2), decode_executor::available_cpus(dir));
+
+    // cgroup v2 comes first, and may have no limit
+    ofstream(dir + "/cpu.max") << "max 100000" << endl;
+    EXPECT_EQ(allowed, decode_executor::available_cpus(dir));
+    ofstream(dir + "/cpu.max") << "250000 100000" << endl;
+    EXPECT_EQ(std::min(allowed, 3), decode_executor::available_cpus(dir));
+}
+
+TEST(loader, decode_autotuner) {
+    // a window of two calls, in which the consumer either waited far longer
+    // than the window took or not at all
+    const uint64_t stall = 1000000000000;
+    decode_autotuner tuner(4, 2);
+    auto window = [&](uint64_t wait_ns, bool pool_full) {
+        EXPECT_FALSE(tuner.record(wait_ns, pool_full));
+        return tuner.record(wait_ns, pool_full);
+    };
+    EXPECT_EQ(4, tuner.threads());
+
+    // decoding keeps ahead of the consumer, so threads go one at a time
+    EXPECT_TRUE(window(0, true));
+    EXPECT_EQ(3, tuner.threads());
+    EXPECT_TRUE(window(0, true));
+    EXPECT_EQ(2, tuner.threads());
+
+    // neither ahead nor behind
+    EXPECT_FALSE(window(0, false));
+    EXPECT_EQ(2, tuner.threads());
+
+    // the consumer waits once one more has gone, so it comes back and the
+    // count is never taken that low again
+    EXPECT_TRUE(window(0, true));
+    EXPECT_EQ(1, tuner.threads());
+    EXPECT_TRUE(window(stall, false));
+    EXPECT_EQ(2, tuner.threads());
+    EXPECT_FALSE(window(0, true));
+    EXPECT_EQ(2, tuner.threads());
+
+    // waiting adds threads up to the limit
+    EXPECT_TRUE(window(stall, false));
+    EXPECT_TRUE(window(stall, false));
+    EXPECT_EQ(4, tuner.threads());
+    EXPECT_FALSE(window(stall, false));
+    EXPECT_EQ(4, tuner.threads());
+
+    // restart() forgets the calls of the window so far
+    tuner.record(stall, false);
+    tuner.restart();
+    EXPECT_TRUE(window(0, true));
+    EXPECT_EQ(3, tuner.threads());
+}
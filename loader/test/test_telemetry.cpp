@@ -0,0 +1,134 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <cmath>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "telemetry.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    // within the 12.5% a bucket spans
+    void expect_near(double expected, double actual)
+    {
+        EXPECT_LE(fabs(actual - expected), 0.125 * expected) << "expected about " << expected;
+    }
+
+    string bottleneck(const telemetry& t)
+    {
+        return t.snapshot()["bottleneck"].get<string>();
+    }
+
+    // samples `count` minibatches with these many waiting in each pool
+    void sample_queues(telemetry& t, int read, int decoded, int count = 10)
+    {
+        for (int i = 0; i < count; i++) {
+            t.read_queue.record(read);
+            t.decode_queue.record(decoded);
+        }
+    }
+}
+
+TEST(telemetry, histogram) {
+    histogram h;
+    EXPECT_EQ(0, h.count());
+    EXPECT_EQ(0, h.mean());
+    EXPECT_EQ(0, h.percentile(50));
+
+    // small values are exact
+    for (int v = 0; v < 8; v++) {
+        h.record(v);
+    }
+    EXPECT_EQ(8, h.count());
+    EXPECT_EQ(3.5, h.mean());
+    EXPECT_EQ(0, h.percentile(0));
+    EXPECT_EQ(3, h.percentile(50));
+    EXPECT_EQ(7, h.percentile(100));
+
+    h.reset();
+    for (int v = 1; v <= 1000; v++) {
+        h.record(v);
+    }
+    EXPECT_EQ(1000, h.count());
+    EXPECT_EQ(500.5, h.mean());
+    expect_near(500, h.percentile(50));
+    expect_near(900, h.percentile(90));
+    expect_near(990, h.percentile(99));
+
+    // a percentile is never more than the largest value seen
+    h.reset();
+    h.record(9);
+    h.record(1000000);
+    EXPECT_EQ(9, h.percentile(0));
+    EXPECT_LE(h.percentile(100), 1000000);
+    expect_near(1000000, h.percentile(100));
+
+    auto js = h.to_json(1e-3);
+    EXPECT_EQ(2, js["count"].get<int>());
+    EXPECT_DOUBLE_EQ(1000, js["max"].get<double>());
+    EXPECT_DOUBLE_EQ((9 + 1000000) / 2.0 * 1e-3, js["mean"].get<double>());
+}
+
+TEST(telemetry, bottleneck) {
+    telemetry t;
+    t.read_queue_depth   = 4;
+    t.decode_queue_depth = 2;
+    EXPECT_EQ("unknown", bottleneck(t));
+
+    // nothing waits anywhere, so the pipeline is waiting on blocks
+    sample_queues(t, 0, 0);
+    EXPECT_EQ("io", bottleneck(t));
+
+    // read minibatches pile up in front of decoding
+    t.reset();
+    sample_queues(t, 4, 0);
+    EXPECT_EQ("decode", bottleneck(t));
+
+    // decoded ones pile up in front of the consumer, whatever is behind
+    t.reset();
+    sample_queues(t, 4, 2);
+    EXPECT_EQ("consumer", bottleneck(t));
+    t.reset();
+    sample_queues(t, 0, 1);
+    EXPECT_EQ("consumer", bottleneck(t));
+}
+
+TEST(telemetry, snapshot) {
+    telemetry t;
+    t.read_queue_depth   = 4;
+    t.decode_queue_depth = 2;
+    t.cache_hits         = 3;
+    t.block_load_ns.record(2000);
+    t.stage_ns[telemetry::transform].record(5000);
+    t.minibatches        = 7;
+    sample_queues(t, 4, 0);
+
+    auto js = t.snapshot();
+    EXPECT_EQ(3, js["read"]["cache_hits"].get<int>());
+    EXPECT_DOUBLE_EQ(2, js["read"]["block_load_us"]["max"].get<double>());
+    EXPECT_DOUBLE_EQ(5, js["decode"]["transform_us"]["max"].get<double>());
+    EXPECT_EQ(0, js["decode"]["extract_us"]["count"].get<int>());
+    EXPECT_EQ(7, js["consumer"]["minibatches"].get<int>());
+    EXPECT_EQ(4, js["queues"]["read"]["depth"].get<int>());
+    EXPECT_EQ(10, js["queues"]["read"]["count"].get<int>());
+    EXPECT_EQ("decode", js["bottleneck"].get<string>());
+
+    t.reset();
+    EXPECT_EQ(0, t.snapshot()["read"]["cache_hits"].get<int>());
+}
@@ -0,0 +1,131 @@
+/*
+ Copyright 2016 Nervana Systems Inc.
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <unistd.h>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "json.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace {
+    // writes `tr` out and parses it back
+    nlohmann::json dump_and_parse(trace& tr)
+    {
+        char filename[] = "/tmp/aeon_trace_XXXXXX";
+        int  fd         = mkstemp(filename);
+        EXPECT_LE(0, fd);
+        close(fd);
+        tr.dump(filename);
+
+        ifstream       in(filename);
+        nlohmann::json js = nlohmann::json::parse(in);
+        unlink(filename);
+        return js;
+    }
+}
+
+TEST(trace, dump) {
+    trace     tr(64);
+    telemetry t;
+    t.tracer = &tr;
+
+    const int thread_count = 3;
+    const int span_count   = 10;
+    vector<thread> threads;
+    for (int i = 0; i < thread_count; i++) {
+        threads.emplace_back([&t, i]() {
+            trace::set_thread_name("worker " + to_string(i));
+            telemetry::scope scope(&t);
+            for (int n = 0; n < span_count; n++) {
+                trace::span span("work", n);
+                // recording into more traces than a thread keeps rings for
+                // in between, so that it has to find its ring again
+                for (int k = 0; k < 10; k++) {
+                    trace other(1);
+                    other.record("other", 0, 1, -1);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    nlohmann::json js = dump_and_parse(tr);
+    EXPECT_EQ("ns", js["displayTimeUnit"].get<string>());
+
+    // a ring and a tid per thread, however often it was looked up again
+    map<int, string> names;
+    map<int, vector<int>> args;
+    for (auto& e : js["traceEvents"]) {
+        int tid = e["tid"].get<int>();
+        if (e["ph"] == "M") {
+            EXPECT_EQ("thread_name", e["name"].get<string>());
+            EXPECT_EQ(0, names.count(tid));
+            names[tid] = e["args"]["name"].get<string>();
+        } else {
+            EXPECT_EQ("X", e["ph"].get<string>());
+            EXPECT_EQ("work", e["name"].get<string>());
+            EXPECT_LE(0, e["ts"].get<double>());
+            EXPECT_LE(0, e["dur"].get<double>());
+            args[tid].push_back(e["args"]["n"].get<int>());
+        }
+    }
+    ASSERT_EQ(thread_count, names.size());
+    ASSERT_EQ(thread_count, args.size());
+    for (auto& a : args) {
+        ASSERT_EQ(1, names.count(a.first));
+        EXPECT_EQ(0, names[a.first].find("worker "));
+        // in the order they were recorded
+        vector<int> expected;
+        for (int n = 0; n < span_count; n++) {
+            expected.push_back(n);
+        }
+        EXPECT_EQ(expected, a.second);
+    }
+}
+
+TEST(trace, ring) {
+    // only the most recent events of a thread are kept, less the slot the
+    // thread may be writing while dump() reads
+    trace tr(4);
+    for (int n = 0; n < 10; n++) {
+        tr.record("event", n * 1000, n * 1000 + 500, n);
+    }
+
+    nlohmann::json js = dump_and_parse(tr);
+    vector<int> args;
+    for (auto& e : js["traceEvents"]) {
+        if (e["ph"] == "X") {
+            args.push_back(e["args"]["n"].get<int>());
+            EXPECT_DOUBLE_EQ(args.back(), e["ts"].get<double>());
+            EXPECT_DOUBLE_EQ(0.5, e["dur"].get<double>());
+        }
+    }
+    EXPECT_EQ(vector<int>({7, 8, 9}), args);
+
+    EXPECT_THROW(tr.dump("/nonexistent/trace.json"), std::runtime_error);
+}